@@ -2,6 +2,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <map>
 
 #include <signal.h>
 
@@ -16,10 +19,14 @@ namespace {
 
 void usage(const char* exe)
 {
-    std::cout<<"Usage: "<<exe<<" [-hd] [-H <iface>[:<port>]] [-L none|rfs] [-S <sec>] <json_file> [initials_file]\n";
+    std::cout<<"Usage: "<<exe<<" [-hd] [-H <iface>[:<port>]] [-L none|rfs|hires] [-S <sec>] [-W <threads>] [-I <impairments>] <json_file> [initials_file]\n"
+               "       "<<exe<<" [-hd] [-S <sec>] [-W <threads>] [-I <impairments>] -M <manifest>\n"
+               "\n"
+               " Manifest lines are:\n"
+               "   <iface>[:<port>] <json_file> [<logic> [<initials_file>]]\n";
 }
 
-Simulator* volatile current;
+SimHost* volatile current;
 
 void handler(int)
 {
@@ -27,6 +34,151 @@ void handler(int)
         current->interrupt();
 }
 
+void read_initials(const char *fname, Simulator::values_t& initial, bool debug)
+{
+    std::ifstream strm(fname);
+    if(!strm.is_open())
+        throw std::runtime_error(SB()<<"Failed to open '"<<fname<<"'");
+
+    std::string line;
+    unsigned lineno=0;
+    while(std::getline(strm, line)) {
+        lineno++;
+        epicsUInt32 addr, value;
+
+        // skip blank
+        if(line.find_first_not_of(" \t\r\n")==line.npos)
+            continue;
+
+        std::istringstream lstrm(line);
+
+        lstrm>>std::hex>>addr>>std::hex>>value;
+        if(lstrm.bad() || !lstrm.eof())
+            throw std::runtime_error(SB()<<fname<<" Error on line "<<lineno);
+
+        if(value!=0) {
+            initial[addr] = value;
+            if(debug)
+                std::cout<<"Initialize "<<std::hex<<addr<<" with "<<std::hex<<value<<"\n";
+        }
+    }
+    if(strm.bad() || !strm.eof())
+        throw std::runtime_error(SB()<<fname<<" Error on or after line "<<lineno<<" "<<std::hex<<strm.rdstate()<<"\n");
+}
+
+// parsed JSON and ROM image, shared by all chassis using the same file
+struct Model {
+    JBlob blob;
+    std::vector<epicsUInt32> rom;
+    size_t romlen;
+};
+
+typedef std::map<std::string, Model> models_t;
+
+const Model& get_model(models_t& models, const std::string& fname)
+{
+    models_t::iterator it(models.find(fname));
+    if(it!=models.end())
+        return it->second;
+
+    std::string json(read_entire_file(fname.c_str()));
+
+    Model& model = models[fname];
+    try {
+        model.blob.parse(json.c_str());
+
+        // build ROM image
+        ROM rom;
+        rom.push_back(ROMDescriptor::Text, "FEED Simulator");
+        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
+        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
+        rom.push_back(ROMDescriptor::JSON, json);
+
+        model.rom.resize(0x800);
+        model.romlen = rom.prepare(&model.rom[0], model.rom.size());
+    }catch(std::exception& e){
+        models.erase(fname);
+        throw std::runtime_error(SB()<<fname<<" : "<<e.what());
+    }
+
+    return model;
+}
+
+Simulator* build_sim(const osiSockAddr& endpoint, const Model& model,
+                     const std::string& logic, const Simulator::values_t& initial)
+{
+    feed::auto_ptr<Simulator> sim;
+    if(logic=="none") {
+        sim.reset(new Simulator(endpoint, model.blob, initial));
+    } else if(logic=="rfs") {
+        sim.reset(new Simulator_RFS(endpoint, model.blob, initial));
+    } else if(logic=="hires") {
+        sim.reset(new Simulator_HIRES(endpoint, model.blob, initial));
+    } else {
+        throw std::runtime_error(SB()<<"Unknown logic name: "<<logic);
+    }
+
+    // copy in ROM image
+    {
+        SimReg& reg = (*sim)["ROM"];
+        size_t n = std::min(reg.storage.size(), model.rom.size());
+        std::copy(model.rom.begin(), model.rom.begin()+n, reg.storage.begin());
+        std::cout<<"ROM contents "<<model.romlen<<"/"<<reg.storage.size()<<"\n";
+    }
+
+    return PTRMOVE(sim).release();
+}
+
+// Each non-blank line: <iface>[:<port>] <json_file> [<logic> [<initials_file>]]
+void read_manifest(const char *fname, SimHost& host, models_t& models, bool debug)
+{
+    std::ifstream strm(fname);
+    if(!strm.is_open())
+        throw std::runtime_error(SB()<<"Failed to open '"<<fname<<"'");
+
+    std::string line;
+    unsigned lineno=0;
+    while(std::getline(strm, line)) {
+        lineno++;
+
+        size_t hash = line.find('#');
+        if(hash!=line.npos)
+            line = line.substr(0, hash);
+
+        std::istringstream lstrm(line);
+        std::string ep, json, logic("none"), initials;
+
+        if(!(lstrm>>ep))
+            continue; // blank or comment
+
+        if(!(lstrm>>json))
+            throw std::runtime_error(SB()<<fname<<":"<<lineno<<" expected <iface>[:<port>] <json_file>");
+        lstrm>>logic>>initials;
+
+        std::string extra;
+        if(lstrm>>extra)
+            throw std::runtime_error(SB()<<fname<<":"<<lineno<<" unexpected '"<<extra<<"'");
+
+        osiSockAddr endpoint;
+        memset(&endpoint, 0, sizeof(endpoint));
+        endpoint.ia.sin_family = AF_INET;
+        if(aToIPAddr(ep.c_str(), 50006, &endpoint.ia))
+            throw std::runtime_error(SB()<<fname<<":"<<lineno<<" invalid host[:port] "<<ep);
+
+        Simulator::values_t initial;
+        if(!initials.empty())
+            read_initials(initials.c_str(), initial, debug);
+
+        try {
+            host.add(build_sim(endpoint, get_model(models, json), logic, initial));
+        }catch(std::exception& e){
+            throw std::runtime_error(SB()<<fname<<":"<<lineno<<" "<<e.what());
+        }
+    }
+    if(strm.bad() || !strm.eof())
+        throw std::runtime_error(SB()<<fname<<" Error on or after line "<<lineno);
+}
+
 } // namespace
 
 int main(int argc, char *argv[])
@@ -35,14 +187,17 @@ int main(int argc, char *argv[])
         int opt;
         bool debug = false;
         double slowdown = 0.0;
+        epicsUInt32 nworkers = 1u;
+        SimImpair impair;
         std::string logic("none");
+        const char *manifest = 0;
         osiSockAddr endpoint;
         memset(&endpoint, 0, sizeof(endpoint));
         endpoint.ia.sin_family = AF_INET;
         endpoint.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
         endpoint.ia.sin_port = htons(50006);
 
-        while((opt=getopt(argc, argv, "hH:dL:S:"))!=-1) {
+        while((opt=getopt(argc, argv, "hH:dL:S:W:I:M:"))!=-1) {
             switch(opt) {
             case 'H':
                 if(aToIPAddr(optarg, 50006, &endpoint.ia))
@@ -58,6 +213,16 @@ int main(int argc, char *argv[])
                 if(epicsParseDouble(optarg, &slowdown, 0))
                     throw std::runtime_error("-S value must be a number");
                 break;
+            case 'W':
+                if(epicsParseUInt32(optarg, &nworkers, 0, 0) || nworkers==0u)
+                    throw std::runtime_error("-W value must be a positive integer");
+                break;
+            case 'I':
+                impair.parse(optarg);
+                break;
+            case 'M':
+                manifest = optarg;
+                break;
             default:
                 std::cerr<<"Unknown option '"<<opt<<"'\n\n";
                 // fall through
@@ -67,90 +232,64 @@ int main(int argc, char *argv[])
             }
         }
 
-        if(optind>=argc) {
-            std::cerr<<"JSON file not specified\n\n";
-            usage(argv[0]);
-            return 2;
-        }
-
-        // read input files
-
-        std::string json(read_entire_file(argv[optind]));
+        SimHost host;
+        host.nthreads = nworkers;
+        models_t models;
 
-        Simulator::values_t initial;
-        if(optind+1<argc) {
-            std::ifstream strm(argv[optind+1]);
-            if(!strm.is_open()) {
-                std::cerr<<"Failed to open '"<<argv[optind+1]<<"'\n";
-                return 1;
+        if(manifest) {
+            if(optind<argc) {
+                std::cerr<<"-M may not be combined with <json_file>\n\n";
+                usage(argv[0]);
+                return 2;
             }
 
-            std::string line;
-            unsigned lineno=0;
-            while(std::getline(strm, line)) {
-                lineno++;
-                epicsUInt32 addr, value;
+            read_manifest(manifest, host, models, debug);
 
-                // skip blank
-                if(line.find_first_not_of(" \t\r\n")==line.npos)
-                    continue;
+            if(host.size()==0u)
+                throw std::runtime_error(SB()<<manifest<<" lists no devices");
 
-                std::istringstream lstrm(line);
+        } else {
+            if(optind>=argc) {
+                std::cerr<<"JSON file not specified\n\n";
+                usage(argv[0]);
+                return 2;
+            }
 
-                lstrm>>std::hex>>addr>>std::hex>>value;
-                if(lstrm.bad() || !lstrm.eof())
-                    throw std::runtime_error(SB()<<argv[optind+1]<<" Error on line "<<lineno);
+            Simulator::values_t initial;
+            if(optind+1<argc)
+                read_initials(argv[optind+1], initial, debug);
 
-                if(value!=0) {
-                    initial[addr] = value;
-                    if(debug)
-                        std::cout<<"Initialize "<<std::hex<<addr<<" with "<<std::hex<<value<<"\n";
-                }
-            }
-            if(strm.bad() || !strm.eof())
-                throw std::runtime_error(SB()<<argv[optind+1]<<" Error on or after line "<<lineno<<" "<<std::hex<<strm.rdstate()<<"\n");
+            host.add(build_sim(endpoint, get_model(models, argv[optind]), logic, initial));
         }
 
-        // build ROM image
+        // JSON only needed during construction
+        models.clear();
 
-        JBlob blob;
-        blob.parse(json.c_str());
+        for(size_t i=0; i<host.size(); i++) {
+            Simulator& sim = host[i];
 
-        ROM rom;
-        rom.push_back(ROMDescriptor::Text, "FEED Simulator");
-        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
-        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
-        rom.push_back(ROMDescriptor::JSON, json);
+            sim.debug = debug;
+            sim.slowdown = slowdown;
+            sim.impair = impair;
 
-        feed::auto_ptr<Simulator> sim;
-        if(logic=="none") {
-            sim.reset(new Simulator(endpoint, blob, initial));
-        } else if(logic=="rfs") {
-            sim.reset(new Simulator_RFS(endpoint, blob, initial));
-        } else if(logic=="hires") {
-            sim.reset(new Simulator_HIRES(endpoint, blob, initial));
-        } else {
-            throw std::runtime_error(SB()<<"Unknown logic name: -L "<<logic);
-        }
-        sim->debug = debug;
-        sim->slowdown = slowdown;
-
-        // copy in ROM image
-        {
-            SimReg& reg = (*sim)["ROM"];
-            size_t len = rom.prepare(&reg.storage[0], reg.storage.size());
-            std::cout<<"ROM contents "<<len<<"/"<<reg.storage.size()<<"\n";
-        }
+            if(host.size()>1u) {
+                osiSockAddr ep;
+                sim.endpoint(ep);
+                char name[64];
+                sockAddrToDottedIP(&ep.sa, name, sizeof(name));
+                std::cout<<"Serving "<<name<<"\n";
+            }
 
-        if(debug) {
-            std::cout<<"Registers:\n";
-            for(Simulator::iterator it=sim->begin(), end=sim->end(); it!=end; ++it)
-            {
-                SimReg& reg = it->second;
-                std::cout<<"  "<<reg.name<<"\t"
-                         <<std::hex<<reg.base<<":"
-                         <<std::hex<<(reg.base+reg.storage.size()-1)
-                         <<"\n";
+            if(debug) {
+                std::cout<<"Registers:\n";
+                for(Simulator::iterator it=sim.begin(), end=sim.end(); it!=end; ++it)
+                {
+                    SimReg& reg = it->second;
+                    std::cout<<"  "<<reg.name<<"\t"
+                             <<std::hex<<reg.base<<":"
+                             <<std::hex<<(reg.base+reg.storage.size()-1)
+                             <<"\n";
+                }
             }
         }
 
@@ -159,8 +298,8 @@ int main(int argc, char *argv[])
         signal(SIGTERM, &handler);
 
         // time to run now...
-        current = sim.get();
-        sim->exec();
+        current = &host;
+        host.exec();
         current = 0;
 
         return 0;
@@ -49,6 +49,9 @@ struct RecInfo : public RegInterest
     bool rbv;
     // push meta-data to record
     bool meta;
+    // raw address window, not described by the JSON.
+    // only used while Running
+    bool raw;
 
     // registry of logical signal names
     typedef std::map<std::string, RecInfo*> signals_t;
@@ -4,16 +4,23 @@
 #include <algorithm>
 
 #include <poll.h>
+#ifdef __linux__
+#  include <sys/mman.h>
+#endif
+
+#include <zlib.h>
 
 #include <errlog.h>
 #include <alarm.h>
 #include <dbAccess.h>
 #include <recSup.h>
 #include <epicsExit.h>
+#include <callback.h>
 
 #include "device.h"
 #include "zpp.h"
 #include "rom.h"
+#include "jregtable.h"
 
 // max number of concurrent requests
 int feedNumInFlight = 1;
@@ -22,6 +29,14 @@ double feedTimeout = 1.0;
 // Size of IP and UDP headers.
 // I don't know how to determine this programatically, so make it configurable.
 int feedUDPHeaderSize = 42;
+// allocate register storage for each Device from a single arena (!=0)
+// or individually from the heap (0)
+int feedRegArena = 1;
+// ignore registers with a larger addr_width (words = 2**addr_width).
+// Can't be more than the 24 address bits of the protocol.
+int feedMaxAddrWidth = 24;
+// reject a ROM when storage for all its registers needs more bytes
+int feedMaxRegBytes = 256*1024*1024;
 
 namespace {
 const size_t pkt_size_limit = (DevMsg::nreg+1)*8;
@@ -72,21 +87,78 @@ RegInterest::RegInterest(dbCommon *prec, Device *dev)
 
 #define IFDBG(N, FMT, ...) if(dev->debug&(1u<<(N))) errlogPrintf("%s %s : " FMT "\n", logTime(), dev->myname.c_str(), __VA_ARGS__)
 
-DevReg::DevReg(Device *dev, const JRegister &info, bool bootstrap)
+RegArena::RegArena(size_t limit)
+    :capacity(limit)
+    ,used(0u)
+    ,nallocs(0u)
+    ,huge(false)
+    ,base(0)
+{
+    if(!capacity)
+        return;
+#ifdef __linux__
+    void *mem = mmap(0, capacity, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(mem==MAP_FAILED)
+        throw std::bad_alloc();
+    base = static_cast<char*>(mem);
+#  ifdef MADV_HUGEPAGE
+    // only worthwhile for large designs
+    if(capacity >= 2u*1024u*1024u)
+        huge = madvise(base, capacity, MADV_HUGEPAGE)==0;
+#  endif
+#else
+    base = static_cast<char*>(calloc(capacity, 1));
+    if(!base)
+        throw std::bad_alloc();
+#endif
+}
+
+RegArena::~RegArena()
+{
+#ifdef __linux__
+    if(base)
+        munmap(base, capacity);
+#else
+    free(base);
+#endif
+}
+
+void* RegArena::alloc(size_t bytes)
+{
+    // keep 8 byte alignment
+    bytes = (bytes+7u)&~size_t(7u);
+    if(!base || bytes > capacity-used)
+        return 0;
+    void *ret = base+used;
+    used += bytes;
+    nallocs++;
+    return ret;
+}
+
+size_t RegArena::reg_footprint(size_t nwords)
+{
+    // mem_rx, mem_tx, and received
+    return 2u*((nwords*4u+7u)&~size_t(7u)) + ((nwords+7u)&~size_t(7u));
+}
+
+DevReg::DevReg(Device *dev, const JRegister &info, bool bootstrap, RegArena *arena, size_t nwords)
     :dev(dev)
     ,info(info)
     ,bootstrap(bootstrap)
     ,state(Invalid)
     ,read_queued(false)
     ,write_queued(false)
-    ,mem_rx(1u<<info.addr_width, 0)
-    ,mem_tx(1u<<info.addr_width, 0)
-    ,received(1u<<info.addr_width, false)
     ,nremaining(0u)
-    ,next_send(mem_rx.size())
+    ,next_send(nwords ? nwords : 1u<<info.addr_width)
     ,stat(UDF_ALARM)
     ,sevr(INVALID_ALARM)
-{}
+{
+    if(!nwords)
+        nwords = 1u<<info.addr_width;
+    mem_rx.alloc(nwords, arena);
+    mem_tx.alloc(nwords, arena);
+    received.alloc(nwords, arena);
+}
 
 DevReg::~DevReg()
 {
@@ -224,6 +296,8 @@ Device::Device(const std::string &name, osiSockAddr &ep)
     ,myname(name)
     ,debug(0xffffffff)
     ,current(Idle)
+    ,blob_gen(0u)
+    ,blobs_ready(false)
     ,cnt_sent(0u)
     ,cnt_recv(0u)
     ,cnt_recv_bytes(0u)
@@ -317,42 +391,71 @@ void Device::reset(bool error)
 
     reg_send.clear();
 
-    for(reg_by_name_t::const_iterator it = reg_by_name.begin(), end = reg_by_name.end();
-        it != end; ++it)
+    for(unsigned pass=0; pass<2; pass++)
     {
-        DevReg *reg = it->second;
-
-        // put all register contents into a known state
-        // on disconnect.
-        std::fill(reg->mem_rx.begin(),
-                  reg->mem_rx.end(),
-                  0);
-        std::fill(reg->mem_tx.begin(),
-                  reg->mem_tx.end(),
-                  0);
-
-        // complete any in-progress async, including for queued writes
-        reg->stat = COMM_ALARM;
-        reg->sevr = INVALID_ALARM;
-        reg->process(true);
+        const reg_by_name_t& regs = pass==0 ? reg_by_name : reg_raw;
+
+        for(reg_by_name_t::const_iterator it = regs.begin(), end = regs.end();
+            it != end; ++it)
+        {
+            DevReg *reg = it->second;
+
+            // put all register contents into a known state
+            // on disconnect.
+            std::fill(reg->mem_rx.begin(),
+                      reg->mem_rx.end(),
+                      0);
+            std::fill(reg->mem_tx.begin(),
+                      reg->mem_tx.end(),
+                      0);
+
+            // complete any in-progress async, including for queued writes
+            reg->stat = COMM_ALARM;
+            reg->sevr = INVALID_ALARM;
+            reg->process(true);
 
-        if(!reg->bootstrap) {
-            delete reg;
-        } else {
             reg->reset();
         }
     }
 
+    // set aside the current register map (w/ storage and interest lists)
+    // in case the device comes back with the same JSON.
+    // A reset before reaching Running again leaves an earlier cache in place.
+    {
+        reg_by_name_t retain;
+        for(reg_by_name_t::const_iterator it = reg_by_name.begin(), end = reg_by_name.end();
+            it != end; ++it)
+        {
+            if(!it->second->bootstrap)
+                retain[it->first] = it->second;
+        }
+        if(!retain.empty()) {
+            clear_reg_cache();
+            reg_cache.swap(retain);
+            reg_cache_key = reg_map_key;
+            info32_cache.swap(info32);
+            arena_cache.reset(arena.release());
+            raw_infos_cache.clear();
+            if(blobs_ready)
+                raw_infos_cache.swap(raw_infos);
+        }
+    }
+    reg_map_key.clear();
+
     // restart with only automatic/bootstrap registers
     reg_by_name.clear();
     reg_by_name[reg_id->info.name] = reg_id.get();
     reg_by_name[reg_rom2->info.name] = reg_rom2.get();
     reg_by_name[reg_rom16->info.name] = reg_rom16.get();
+    index_registers();
 
     if(!error) {
         last_message.clear();
     }
     dev_infos.clear();
+    raw_infos.clear();
+    blobs_ready = false;
+    blob_gen++; // discard any BlobJob in progress
     description.clear();
     jsonhash.clear();
     codehash.clear();
@@ -364,7 +467,7 @@ void Device::reset(bool error)
         if(it->second->reg && it->second->reg->bootstrap)
             continue;
 
-        // break association with (now deleted) register
+        // break association with (now cached) register
         it->second->reg = 0;
         scanIoRequest(it->second->changed);
     }
@@ -372,6 +475,64 @@ void Device::reset(bool error)
     scanIoRequest(current_changed);
 }
 
+void Device::index_registers()
+{
+    reg_by_addr.clear();
+
+    // overlaps are a property of the register map, so only complain
+    // the first time a map is seen, not on every reconnect.
+    const bool report = !reg_map_key.empty() && reg_map_key!=reg_overlap_key;
+
+    // bootstrap registers last so that they take precedence
+    for(unsigned pass=0; pass<2; pass++)
+    {
+        for(reg_by_name_t::const_iterator it = reg_by_name.begin(), end = reg_by_name.end();
+            it != end; ++it)
+        {
+            DevReg *reg = it->second;
+            if(reg->bootstrap != (pass==1))
+                continue;
+
+            std::vector<DevReg*> displaced;
+            if(reg_by_addr.insert(reg->info.base_addr, reg->mem_rx.size(), reg, &displaced) && report) {
+                for(size_t i=0; i<displaced.size(); i++)
+                    errlogPrintf("%s: Overlapping registers %s and %s\n", myname.c_str(),
+                                 displaced[i]->info.name.c_str(), reg->info.name.c_str());
+            }
+        }
+    }
+
+    if(report)
+        reg_overlap_key = reg_map_key;
+}
+
+DevReg* Device::reg_by_address(epicsUInt32 addr, epicsUInt32 *offset) const
+{
+    const reg_by_addr_t::Range *range = reg_by_addr.find(addr&0x00ffffff);
+    if(!range)
+        return 0;
+
+    DevReg *reg = range->value;
+    if(offset)
+        *offset = (addr&0x00ffffff) - reg->info.base_addr;
+    return reg;
+}
+
+void Device::clear_reg_cache()
+{
+    for(reg_by_name_t::const_iterator it = reg_cache.begin(), end = reg_cache.end();
+        it != end; ++it)
+    {
+        delete it->second;
+    }
+    reg_cache.clear();
+    reg_cache_key.clear();
+    info32_cache.clear();
+    raw_infos_cache.clear();
+    // after registers are free'd
+    arena_cache.reset();
+}
+
 void Device::handle_send(Guard& G)
 {
     const epicsTime due(loop_time + feedTimeout);
@@ -654,47 +815,161 @@ void Device::do_timeout(unsigned i)
     msg.clear();
 }
 
+namespace {
+// Build and compress dev_infos, and raw_infos, without holding Device::lock
+struct BlobJob
+{
+    CALLBACK cb;
+    Device * const dev;
+    // result discarded if Device::blob_gen changes (eg. reset() )
+    const epicsUInt32 gen;
+
+    // inputs
+    std::string peer,
+                json; // empty to keep current raw_infos
+    RegInterest::infos_t infos;
+
+    // outputs
+    std::vector<char> dev_infos, raw_infos;
+
+    explicit BlobJob(Device *dev)
+        :dev(dev)
+        ,gen(++dev->blob_gen)
+    {
+        callbackSetCallback(&BlobJob::run, &cb);
+        callbackSetPriority(priorityLow, &cb);
+        callbackSetUser(this, &cb);
+    }
+
+    void build()
+    {
+        std::ostringstream strm;
+
+        strm<<"{"
+                "\"peer\": \""<<peer<<"\","
+                "\"records\": {";
+
+        bool first1 = true;
+        for(RegInterest::infos_t::const_iterator it(infos.begin()), end(infos.end()); it!=end; ++it)
+        {
+            if(!first1) {
+                strm<<",";
+            } else {
+                first1 = false;
+            }
+            strm<<"\""<<it->first<<"\": {";
+            bool first2 = true;
+            for(RegInterest::info_items_t::const_iterator it2(it->second.begin()), end2(it->second.end()); it2!=end2; ++it2)
+            {
+                if(!first2) {
+                    strm<<",";
+                } else {
+                    first2 = false;
+                }
+                strm<<"\""<<it2->first<<"\": "<<it2->second;
+            }
+            strm<<"}";
+        }
+
+        strm<<  "}"
+              "}";
+
+        std::string jstring(strm.str());
+
+        zdeflate(dev_infos, jstring.c_str(), jstring.size(), 9);
+
+        if(!json.empty())
+            zdeflate(raw_infos, json.c_str(), json.size(), 9);
+    }
+
+    // call with Device::lock held
+    void publish()
+    {
+        if(gen!=dev->blob_gen)
+            return; // stale
+
+        dev->dev_infos.swap(dev_infos);
+        if(!json.empty())
+            dev->raw_infos.swap(raw_infos);
+        dev->blobs_ready = true;
+
+        scanIoRequest(dev->current_changed);
+    }
+
+    // call with Device::lock held.
+    // Publish empty blobs so that readers see an error, not "Not ready" forever
+    void publish_error(const char *msg)
+    {
+        if(gen!=dev->blob_gen)
+            return; // stale
+
+        dev->dev_infos.clear();
+        dev->raw_infos.clear();
+        dev->blobs_ready = true;
+        dev->last_message = SB()<<"JSON blobs: "<<msg;
+
+        scanIoRequest(dev->current_changed);
+    }
+
+    static void run(CALLBACK *cb)
+    {
+        void *raw;
+        callbackGetUser(raw, cb);
+        BlobJob *job = static_cast<BlobJob*>(raw);
+        feed::auto_ptr<BlobJob> owner(job);
+        try {
+            job->build();
+
+            Guard G(job->dev->lock);
+            job->publish();
+        } catch(std::exception& e) {
+            errlogPrintf("%s: error building JSON blobs: %s\n", job->dev->myname.c_str(), e.what());
+
+            Guard G(job->dev->lock);
+            job->publish_error(e.what());
+        }
+    }
+};
+} // namespace
+
 void Device::handle_inspect(Guard &G)
 {
     // Process ROM to extract JSON
 
-    ROM rom2, rom16, rom;
+    // Try to decode ROM starting at 0x800 and then 0x4000.
+    // Descriptors are decoded in place from mem_rx
+    ROMView rom2((char*)&reg_rom2->mem_rx[0], reg_rom2->mem_rx.size()*4),
+            rom16((char*)&reg_rom16->mem_rx[0], reg_rom16->mem_rx.size()*4);
 
-    // Try to decode ROM starting at 0x800 and then 0x4000
-    rom2.parse((char*)&reg_rom2->mem_rx[0], reg_rom2->mem_rx.size()*4);
-    if (rom2.begin() != rom2.end()) {
-        rom = rom2;
-    } else {
-        rom16.parse((char*)&reg_rom16->mem_rx[0], reg_rom16->mem_rx.size()*4);
-        rom = rom16;
-    }
+    const ROMView& rom = rom2.begin() != rom2.end() ? rom2 : rom16;
 
-    std::string json;
+    std::string json, temp;
 
     unsigned i=0;
-    for(ROM::infos_t::const_iterator it = rom.begin(), end = rom.end();
+    for(ROMView::const_iterator it = rom.begin(), end = rom.end();
         it != end; ++it, i++)
     {
-        const ROMDescriptor& desc = *it;
+        const ROMView::Entry& desc = *it;
 
         switch(desc.type) {
         case ROMDescriptor::Invalid:
             IFDBG(2, "ROM contains invalid descriptor #%u", i);
             break;
         case ROMDescriptor::Text:
-            IFDBG(2, "ROM desc \"%s\"", desc.value.c_str());
+            desc.decode(temp);
+            IFDBG(2, "ROM desc \"%s\"", temp.c_str());
             if(description.empty())
-                description = desc.value;
+                description = temp;
             break;
         case ROMDescriptor::BigInt:
             if(jsonhash.empty())
-                jsonhash = desc.value;
+                desc.decode(jsonhash);
             else if(codehash.empty())
-                codehash = desc.value;
+                desc.decode(codehash);
             break; // ignore
         case ROMDescriptor::JSON:
             if(json.empty())
-                json = desc.value;
+                desc.decode(json);
             else
                 IFDBG(2, "ROM ignoring addition JSON #%u", i);
 
@@ -705,90 +980,133 @@ void Device::handle_inspect(Guard &G)
     if(json.empty())
         throw std::runtime_error("ROM contains no JSON");
 
-    JBlob blob;
-    blob.parse(json.c_str());
+    // identify this register map.  jsonhash alone is not trusted
+    // as some (eg. simulated) devices leave it zero'd.
+    std::string mapkey(SB()<<jsonhash<<":"<<std::hex<<crc32(0, (const Bytef*)json.c_str(), json.size()));
 
-    info32.swap(blob.info32);
+    const bool reused = !reg_cache.empty() && mapkey==reg_cache_key;
 
-    zdeflate(raw_infos, json.c_str(), json.size(), 9);
+    if(reused) {
+        IFDBG(2, "ROM unchanged, re-use %u registers", unsigned(reg_cache.size()));
 
-    // iterate registers and find interested
-    for(JBlob::const_iterator it = blob.begin(), end = blob.end(); it != end; ++it)
-    {
-        const JRegister& reg = it->second;
+        // Fast path.  Register storage and interest lists are kept,
+        // and raw_infos if it was built before reset().
+        for(reg_by_name_t::const_iterator it = reg_cache.begin(), end = reg_cache.end();
+            it != end; ++it)
+        {
+            DevReg *reg = it->second;
 
-        if(reg_by_name.find(reg.name)!=reg_by_name.end())
-            continue; // don't overwrite automatic/bootstrap register
+            for(DevReg::interested_t::const_iterator it2(reg->interested.begin()), end2(reg->interested.end());
+                it2 != end2; ++it2)
+            {
+                (*it2)->reg = reg;
+            }
 
-        IFDBG(2, "add register %s", reg.name.c_str());
+            reg_by_name[it->first] = reg;
+        }
+        reg_cache.clear();
+        reg_cache_key.clear();
+        info32.swap(info32_cache);
+        info32_cache.clear();
+        arena.reset(arena_cache.release());
+        raw_infos.swap(raw_infos_cache);
+        raw_infos_cache.clear();
 
-        feed::auto_ptr<DevReg> dreg(new DevReg(this, reg));
+    } else {
+        clear_reg_cache();
 
-        // The following isn't directly exception safe (leaves dangling pointers)
-        // however, the catch in run() will call reset() which cleans these up
+        JRegTable table;
+        table.parse(json.c_str(), json.size());
 
-        // fill in list of interested records
-        std::pair<reg_interested_t::const_iterator, reg_interested_t::const_iterator> range;
-        range = reg_interested.equal_range(reg.name);
+        table.get(info32);
 
-        for(; range.first != range.second; ++range.first)
-        {
-            RegInterest *interest = range.first->second;
+        const unsigned max_addr_width = std::max(0, std::min(feedMaxAddrWidth, 24));
+        const size_t max_bytes = size_t(std::max(0, feedMaxRegBytes));
 
-            dreg->interested.push_back(interest);
+        size_t total = 0u;
+        for(size_t i=0, N=table.nregs(); i<N; i++)
+        {
+            const JRegTable::Entry& ent = table.entry(i);
+            if(ent.addr_width <= max_addr_width
+                    && reg_by_name.find(table.name(i))==reg_by_name.end())
+                total += RegArena::reg_footprint(size_t(1u)<<ent.addr_width);
+        }
+        if(total > max_bytes)
+            throw std::runtime_error(SB()<<"ROM registers need "<<total<<" bytes > feedMaxRegBytes="<<max_bytes);
 
-            interest->reg = dreg.get();
+        arena.reset();
+        if(feedRegArena) {
+            arena.reset(new RegArena(total));
         }
 
-        reg_by_name[reg.name] = dreg.release();
-    }
+        JRegister reg;
 
-    RegInterest::infos_t infos;
+        // iterate registers and find interested
+        for(size_t i=0, N=table.nregs(); i<N; i++)
+        {
+            table.get(i, reg);
 
-    for(reg_interested_t::iterator it(reg_interested.begin()), end(reg_interested.end());
-        it != end; ++it)
-    {
-        const RegInterest * const interest = it->second;
+            if(reg_by_name.find(reg.name)!=reg_by_name.end())
+                continue; // don't overwrite automatic/bootstrap register
 
-        interest->getInfo(infos);
-    }
+            if(reg.addr_width > max_addr_width) {
+                errlogPrintf("%s: ignore register %s with addr_width=%u > feedMaxAddrWidth=%u\n",
+                             myname.c_str(), reg.name.c_str(), reg.addr_width, max_addr_width);
+                continue;
+            }
 
-    // Print driver JSON blob
-    std::ostringstream strm;
+            IFDBG(2, "add register %s", reg.name.c_str());
 
-    strm<<"{"
-            "\"peer\": \""<<peer_name<<"\","
-            "\"records\": {";
+            feed::auto_ptr<DevReg> dreg(new DevReg(this, reg, false, arena.get()));
 
-    bool first1 = true;
-    for(RegInterest::infos_t::const_iterator it(infos.begin()), end(infos.end()); it!=end; ++it)
-    {
-        if(!first1) {
-            strm<<",";
-        } else {
-            first1 = false;
-        }
-        strm<<"\""<<it->first<<"\": {";
-        bool first2 = true;
-        for(RegInterest::info_items_t::const_iterator it2(it->second.begin()), end2(it->second.end()); it2!=end2; ++it2)
-        {
-            if(!first2) {
-                strm<<",";
-            } else {
-                first2 = false;
+            // The following isn't directly exception safe (leaves dangling pointers)
+            // however, the catch in run() will call reset() which cleans these up
+
+            // fill in list of interested records
+            std::pair<reg_interested_t::const_iterator, reg_interested_t::const_iterator> range;
+            range = reg_interested.equal_range(reg.name);
+
+            for(; range.first != range.second; ++range.first)
+            {
+                RegInterest *interest = range.first->second;
+
+                dreg->interested.push_back(interest);
+
+                interest->reg = dreg.get();
             }
-            strm<<"\""<<it2->first<<"\": "<<it2->second;
+
+            reg_by_name[reg.name] = dreg.release();
         }
-        strm<<"}";
     }
 
-    strm<<  "}"
-          "}";
+    reg_map_key = mapkey;
 
-    std::string jstring(strm.str());
+    index_registers();
 
-    dev_infos.clear();
-    zdeflate(dev_infos, jstring.c_str(), jstring.size(), 9);
+    // JSON formatting and compression are done by a low priority worker.
+    // Meanwhile, "FEED JBlob" reports not ready.
+    feed::auto_ptr<BlobJob> job(new BlobJob(this));
+
+    job->peer = peer_name;
+    if(raw_infos.empty()) {
+        job->json.swap(json);
+    }
+
+    for(reg_interested_t::iterator it(reg_interested.begin()), end(reg_interested.end());
+        it != end; ++it)
+    {
+        const RegInterest * const interest = it->second;
+
+        interest->getInfo(job->infos);
+    }
+
+    if(callbackRequest(&job->cb)==0) {
+        job.release(); // BlobJob::run() will delete
+    } else {
+        IFDBG(2, "callback queue full, compressing blobs in worker");
+        job->build();
+        job->publish();
+    }
 
     {
         UnGuard U(G);
@@ -1030,6 +1348,51 @@ void Device::run()
     IFDBG(4, "Runner stopping");
 }
 
+void Device::mem_usage(MemUsage& usage) const
+{
+    usage = MemUsage();
+
+    for(unsigned pass=0; pass<3; pass++)
+    {
+        const reg_by_name_t& regs = pass==0 ? reg_by_name : pass==1 ? reg_cache : reg_raw;
+
+        for(reg_by_name_t::const_iterator it(regs.begin()), end(regs.end());
+            it != end; ++it)
+        {
+            const DevReg *reg = it->second;
+
+            usage.regs += sizeof(*reg);
+            // arena storage counted below
+            if(!reg->mem_rx.borrowed())
+                usage.regs += reg->mem_rx.size()*sizeof(DevReg::mem_t::value_type);
+            if(!reg->mem_tx.borrowed())
+                usage.regs += reg->mem_tx.size()*sizeof(DevReg::mem_t::value_type);
+            if(!reg->received.borrowed())
+                usage.regs += reg->received.size()*sizeof(DevReg::flags_t::value_type);
+
+            usage.interests += reg->interested.capacity()*sizeof(RegInterest*);
+        }
+    }
+    if(arena.get())
+        usage.regs += arena->capacity;
+    if(arena_cache.get())
+        usage.regs += arena_cache->capacity;
+
+    for(size_t i=0, N=inflight.size(); i<N; i++)
+    {
+        usage.msgs += sizeof(inflight[i]) + inflight[i].buf.capacity()*sizeof(epicsUInt32);
+    }
+
+    usage.blobs = dev_infos.capacity() + raw_infos.capacity() + raw_infos_cache.capacity();
+
+    for(reg_interested_t::const_iterator it(reg_interested.begin()), end(reg_interested.end());
+        it != end; ++it)
+    {
+        // approximate map node overhead
+        usage.interests += sizeof(*it) + 4u*sizeof(void*) + it->first.capacity();
+    }
+}
+
 void Device::show ( unsigned int ) const {}
 
 void Device::show(std::ostream& strm, int lvl) const
@@ -1047,6 +1410,32 @@ void Device::show(std::ostream& strm, int lvl) const
           " Cnt SQ: "<<send_seq<<"\n"
           ;
 
+    {
+        size_t nheap = 0u, nborrowed = 0u;
+        for(reg_by_name_t::const_iterator it(reg_by_name.begin()), end(reg_by_name.end());
+            it != end; ++it)
+        {
+            const DevReg *reg = it->second;
+            if(reg->mem_rx.borrowed()) nborrowed++; else nheap++;
+            if(reg->mem_tx.borrowed()) nborrowed++; else nheap++;
+            if(reg->received.borrowed()) nborrowed++; else nheap++;
+        }
+        strm<<" Reg. storage: "<<reg_by_name.size()<<" registers, "<<nheap<<" heap allocs, "
+            <<nborrowed<<" arena allocs\n";
+        if(arena.get())
+            strm<<" Arena: "<<arena->used<<"/"<<arena->capacity<<" bytes in "<<arena->nallocs<<" allocs"
+                <<(arena->huge ? " (hugepage)" : "")<<"\n";
+        if(!reg_cache.empty())
+            strm<<" Cached registers: "<<reg_cache.size()<<"\n";
+    }
+
+    {
+        MemUsage usage;
+        mem_usage(usage);
+        strm<<" Memory: "<<usage.total()<<" bytes (regs "<<usage.regs<<", msgs "<<usage.msgs
+            <<", blobs "<<usage.blobs<<", interests "<<usage.interests<<")\n";
+    }
+
     if(lvl<=0)
         return;
 
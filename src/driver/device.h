@@ -5,6 +5,8 @@
 #include <list>
 #include <map>
 #include <deque>
+#include <vector>
+#include <stdexcept>
 
 #include <epicsMutex.h>
 #include <epicsGuard.h>
@@ -16,6 +18,7 @@
 #include <shareLib.h>
 
 #include "jblob.h"
+#include "addrindex.h"
 #include "utils.h"
 
 typedef epicsGuard<epicsMutex> Guard;
@@ -48,10 +51,89 @@ struct RegInterest
     virtual void connected() {};
 };
 
+// Contiguous, zero'd, storage for the registers of one Device.
+// Sized when the ROM is inspected.  Never grows.
+struct RegArena
+{
+    explicit RegArena(size_t limit);
+    ~RegArena();
+
+    // returns NULL when exhausted
+    void* alloc(size_t bytes);
+
+    const size_t capacity;
+    size_t used,
+           nallocs;
+    bool huge; // hugepage advice given
+
+    // bytes needed from an arena to store a register w/ this many words
+    static size_t reg_footprint(size_t nwords);
+private:
+    char *base;
+    RegArena(const RegArena&);
+    RegArena& operator=(const RegArena&);
+};
+
+// Fixed size array.  Storage borrowed from a RegArena, or heap allocated
+template<typename T>
+struct RegBuf
+{
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    RegBuf() :ptr(0), count(0u) {}
+
+    void alloc(size_t n, RegArena *arena)
+    {
+        void *raw = arena ? arena->alloc(n*sizeof(T)) : 0;
+        if(raw) {
+            ptr = static_cast<T*>(raw);
+        } else {
+            own.resize(n, T());
+            ptr = n ? &own[0] : 0;
+        }
+        count = n;
+    }
+
+    // from a RegArena?
+    bool borrowed() const { return ptr && own.empty(); }
+
+    size_t size() const { return count; }
+
+    iterator begin() { return ptr; }
+    iterator end() { return ptr+count; }
+    const_iterator begin() const { return ptr; }
+    const_iterator end() const { return ptr+count; }
+
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+
+    T& at(size_t i) {
+        if(i>=count)
+            throw std::out_of_range("RegBuf index out of range");
+        return ptr[i];
+    }
+    const T& at(size_t i) const {
+        if(i>=count)
+            throw std::out_of_range("RegBuf index out of range");
+        return ptr[i];
+    }
+private:
+    std::vector<T> own;
+    T *ptr;
+    size_t count;
+    RegBuf(const RegBuf&);
+    RegBuf& operator=(const RegBuf&);
+};
+
 // Device Register
 struct DevReg
 {
-    DevReg(Device *dev, const JRegister& info, bool bootstrap = false);
+    // storage comes from arena when provided and not exhausted.
+    // arena must out-live this DevReg.
+    // nwords overrides the size implied by info.addr_width when non-zero.
+    DevReg(Device *dev, const JRegister& info, bool bootstrap = false, RegArena *arena = 0, size_t nwords = 0u);
     ~DevReg();
 
     Device * const dev;
@@ -70,12 +152,12 @@ struct DevReg
 
     bool inprogress() const { return state==Reading || state==Writing; }
 
-    typedef std::vector<epicsUInt32> mem_t;
+    typedef RegBuf<epicsUInt32> mem_t;
     // storage for this register.  Kept in network byte order
     mem_t mem_rx, // recv cache
           mem_tx; // send cache
 
-    typedef std::vector<bool> flags_t;
+    typedef RegBuf<epicsUInt8> flags_t;
     // track which addresses have been received
     flags_t received;
     // optimization.  a count of the # cleared bits in 'received'
@@ -189,6 +271,11 @@ struct epicsShareClass Device : public epicsThreadRunable
 
     std::vector<char> dev_infos, // compressed json blob of our info.
                       raw_infos; // compressed json blob of raw info.
+    // dev_infos and raw_infos are built by a low priority callback after handle_inspect()
+    // incremented to discard a result in progress
+    epicsUInt32 blob_gen;
+    // set when the result for the current connection is published
+    bool blobs_ready;
 
     epicsUInt32 cnt_sent,
                 cnt_recv,
@@ -212,6 +299,32 @@ struct epicsShareClass Device : public epicsThreadRunable
     typedef std::map<std::string, DevReg*> reg_by_name_t;
     reg_by_name_t reg_by_name;
 
+    // registers in reg_by_name ordered by address range.
+    // Rebuilt by index_registers() whenever reg_by_name changes.
+    typedef AddrIndex<DevReg*> reg_by_addr_t;
+    reg_by_addr_t reg_by_addr;
+
+    // raw address windows, not described by the JSON.
+    // Owned by their records.  Not in reg_by_name, and not removed by reset().
+    reg_by_name_t reg_raw;
+
+    // non-bootstrap registers set aside by reset().
+    // re-used by handle_inspect() if the next ROM describes
+    // the same register map (reg_cache_key matches).
+    // otherwise free'd.
+    reg_by_name_t reg_cache;
+    // identifies the register map currently in reg_by_name, and in reg_cache
+    std::string reg_map_key, reg_cache_key;
+    // last register map checked for overlaps by index_registers()
+    std::string reg_overlap_key;
+    // __metadata__ keys which go along with reg_cache
+    JBlob::info32_t info32_cache;
+    // raw_infos which goes along with reg_cache.  empty if not built before reset()
+    std::vector<char> raw_infos_cache;
+
+    // storage for registers in reg_by_name, and in reg_cache
+    feed::auto_ptr<RegArena> arena, arena_cache;
+
     // list of registers queued to be sent.
     // front() entry is currently being sent
     typedef std::deque<DevReg*> reg_send_t;
@@ -245,6 +358,13 @@ struct epicsShareClass Device : public epicsThreadRunable
 
     void request_reset();
     void reset(bool error=false);
+    // free registers in reg_cache
+    void clear_reg_cache();
+    void index_registers();
+    // find the register containing a device address (24 bits),
+    // and the word offset within it.  Returns NULL if not found.
+    // Caller must hold lock.
+    DevReg* reg_by_address(epicsUInt32 addr, epicsUInt32 *offset=0) const;
 
     // handle_* called from run().
 
@@ -267,6 +387,18 @@ struct epicsShareClass Device : public epicsThreadRunable
 
     void show(std::ostream& strm, int lvl) const;
 
+    // estimated memory footprint in bytes.
+    struct MemUsage {
+        size_t regs,      // register storage, incl. reg_cache
+               msgs,      // inflight message buffers
+               blobs,     // dev_infos and raw_infos
+               interests; // reg_interested and interested lists
+        MemUsage() :regs(0u), msgs(0u), blobs(0u), interests(0u) {}
+        size_t total() const { return regs+msgs+blobs+interests; }
+    };
+    // call with lock held
+    void mem_usage(MemUsage& usage) const;
+
     static epicsMutex devices_lock;
     typedef std::map<std::string, Device*> devices_t;
     static devices_t devices;
@@ -276,5 +408,8 @@ extern int feedNumInFlight;
 extern double feedTimeout;
 extern int feedUDPHeaderSize;
 extern int feedUDPPortNum;
+extern int feedRegArena;
+extern int feedMaxAddrWidth;
+extern int feedMaxRegBytes;
 
 #endif // DEVICE_H
@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <algorithm>
 
 #include <stdio.h>
 
@@ -214,6 +215,25 @@ long read_counter(longinRecord *prec)
         case 4: prec->val = device->cnt_err; break;
         case 5: prec->val = device->send_seq; break;
         case 6: prec->val = device->cnt_recv_bytes; break;
+        case 7:
+        case 8:
+        case 9:
+        case 10:
+        case 11: {
+            Device::MemUsage usage;
+            device->mem_usage(usage);
+            size_t val;
+            switch(info->offset) {
+            case 7: val = usage.regs; break;
+            case 8: val = usage.msgs; break;
+            case 9: val = usage.blobs; break;
+            case 10: val = usage.interests; break;
+            default: val = usage.total(); break;
+            }
+            // saturate
+            prec->val = std::min(val, size_t(0x7fffffff));
+        }
+            break;
         default:
             (void)recGblSetSevrMsg(prec, READ_ALARM, INVALID_ALARM, "offset= out of range");
         }
@@ -290,7 +310,11 @@ long read_jblob(aaiRecord *prec)
             throw std::runtime_error("invalid jblob offset");
         }
 
-        if(blob->empty()) {
+        if(!device->blobs_ready && device->current==Device::Running) {
+            IFDBG(6, "Not ready");
+            (void)recGblSetSevrMsg(prec, COMM_ALARM, INVALID_ALARM, "Not ready");
+            return ENODEV;
+        } else if(!device->blobs_ready || blob->empty()) {
             IFDBG(6, "Not connected");
         } else if(blob->size() > prec->nelm) {
             IFDBG(6, "blob size %zu exceeds NELM=%u",
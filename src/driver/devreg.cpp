@@ -57,6 +57,27 @@ struct RecRegInfo final : public RecInfo
     virtual void connected() override;
 };
 
+// Raw window of count= words from address addr=.
+// Not described by the JSON, so always "connected",
+// but requests are rejected unless the device is Running.
+template<typename Rec>
+struct RecRawInfo final : public RecInfo
+{
+    epicsUInt32 addr, count;
+    feed::auto_ptr<DevReg> window;
+
+    RecRawInfo(dbCommon *prec, Device *device)
+        :RecInfo(prec, device)
+        ,addr(0u)
+        ,count(0u)
+    {
+        raw = true;
+    }
+    virtual ~RecRawInfo() {}
+
+    virtual void configure(const pairs_t& pairs) override;
+};
+
 #define TRY RecInfo *info = static_cast<RecInfo*>(prec->dpvt); if(!info) { \
     (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM); return ENODEV; } \
     Device *device=info->device; (void)device; try
@@ -86,6 +107,8 @@ long write_register_common(dbCommon *prec, const char *raw, size_t count, menuFt
 
         if(!info->reg) {
             IFDBG(6, "No association");
+        } else if(info->raw && device->current!=Device::Running) {
+            IFDBG(6, "Not Running");
         } else if(!info->reg->info.writable) {
             IFDBG(6, "Not writable");
         } else if(info->offset >= info->reg->mem_tx.size()
@@ -197,6 +220,9 @@ long read_register_common(dbCommon *prec, char *raw, size_t *count, menuFtype ft
         if(!info->reg) {
             IFDBG(6, "No association");
 
+        } else if(info->raw && device->current!=Device::Running) {
+            IFDBG(6, "Not Running");
+
         } else {
             DevReg::mem_t& mem = info->rbv ? info->reg->mem_tx : info->reg->mem_rx;
 
@@ -399,8 +425,45 @@ template<> void RecRegInfo<biRecord>::connected() {}
 template<> void RecRegInfo<mbbiRecord>::connected() {}
 template<> void RecRegInfo<aaiRecord>::connected() {}
 
+template<typename Rec>
+void RecRawInfo<Rec>::configure(const pairs_t& pairs)
+{
+    RecInfo::configure(pairs);
+
+    if(pairs.find("reg")!=pairs.end())
+        throw std::runtime_error("reg= not allowed with raw address window");
+    if(!get_pair(pairs, "addr", addr))
+        throw std::runtime_error("Omitted required key addr=");
+
+    count = ((Rec*)prec)->nelm;
+    get_pair(pairs, "count", count);
+
+    if(addr>0x00ffffff || count==0u || count>0x01000000-addr)
+        throw std::runtime_error(SB()<<"Raw window addr="<<addr<<" count="<<count<<" outside of 24-bit address space");
+
+    JRegister info;
+    info.name = SB()<<"raw:"<<prec->name;
+    info.description = "Raw address window";
+    info.base_addr = addr;
+    info.data_width = 32;
+    info.readable = info.writable = true;
+
+    window.reset(new DevReg(device, info, false, 0, count));
+    window->interested.push_back(this);
+
+    Guard G(device->lock);
+
+    if(!device->reg_raw.insert(std::make_pair(info.name, window.get())).second)
+        throw std::logic_error("Duplicate raw window");
+    reg = window.get();
+}
+
 } // namespace
 
+// raw address windows
+DSET(devAaiFEEDRaw, aai, init_common<RecRawInfo<aaiRecord> >::fn, get_reg_changed_intr, read_register_aai)
+DSET(devAaoFEEDRaw, aao, init_common<RecRawInfo<aaoRecord> >::fn, NULL, write_register_aao)
+
 // register writes
 DSET(devLoFEEDWriteReg, longout, init_common<RecRegInfo<longoutRecord> >::fn, NULL, write_register_lo)
 DSET(devAoFEEDWriteReg, ao, init_common<RecRegInfo<aoRecord> >::fn, NULL, write_register_ao)
@@ -201,6 +201,7 @@ RecInfo::RecInfo(dbCommon *prec, Device *device)
     ,wait(true)
     ,rbv(false)
     ,meta(false)
+    ,raw(false)
 {}
 
 RecInfo::~RecInfo()
@@ -59,4 +59,7 @@ epicsExportAddress(int, feedNumInFlight);
 epicsExportAddress(double, feedTimeout);
 epicsExportAddress(int, feedUDPHeaderSize);
 epicsExportAddress(int, feedUDPPortNum);
+epicsExportAddress(int, feedRegArena);
+epicsExportAddress(int, feedMaxAddrWidth);
+epicsExportAddress(int, feedMaxRegBytes);
 }
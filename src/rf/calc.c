@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <float.h>
 #include <complex.h>
 
 #include <errlog.h>
@@ -13,6 +15,7 @@
 #include <registryFunction.h>
 #include <postfix.h>
 
+#include <compilerDependencies.h>
 #include <epicsMath.h>
 #include <epicsTypes.h>
 
@@ -36,6 +39,87 @@ double phase_wrap(double pha)
     return out;
 }
 
+/* wrap phase in [-360, 360) to [-180, 180) without branches,
+ * so that loops using it may be vectorized.
+ */
+static EPICS_ALWAYS_INLINE
+double phase_wrap_fast(double pha)
+{
+    pha = pha >= 180.0 ? pha - 360.0 : pha;
+    return pha < -180.0 ? pha + 360.0 : pha;
+}
+
+/* atan2() approximation in radians, without branches.
+ * Polynomial for atan() on [0, 1], fit by least squares.
+ * Max. error 6.3e-9 rad (3.6e-7 deg.)
+ * Always inlined, as calls would prevent vectorization.
+ */
+static EPICS_ALWAYS_INLINE
+double atan2_fast(double y, double x)
+{
+    double ax = fabs(x), ay = fabs(y),
+           mn = MIN(ax, ay), mx = MAX(ax, ay),
+           a = mn / (mx==0.0 ? 1.0 : mx), /* 0/0 -> 0 */
+           s = a*a,
+           r;
+
+    r = 0.002468246625604636;
+    r = r*s - 0.01445869707100855;
+    r = r*s + 0.03989956004480673;
+    r = r*s - 0.07247950662619565;
+    r = r*s + 0.1050731978716877;
+    r = r*s - 0.14164333375154126;
+    r = r*s + 0.19986537489148143;
+    r = r*s - 0.33332657852596437;
+    r = r*s + 0.9999999055457109;
+    r *= a;
+
+    r = ay > ax ? PI/2.0 - r : r;
+    r = x < 0.0 ? PI - r : r;
+    r = y < 0.0 ? -r : r;
+    /* MIN()/MAX() may drop a NaN, so propagate it as atan2() does */
+    return x==x && y==y ? r : x+y;
+}
+
+/* sin() and cos() of an angle in degrees, without branches.
+ * Reduced to [0, 90] by symmetry, then Taylor series to 14th order.
+ * Reduction is exact, so max. error is 1e-11 for any |deg| < 1e16.
+ */
+static EPICS_ALWAYS_INLINE
+void sincos_fast(double deg, double *s, double *c)
+{
+    /* nearest multiple of 360.  Vectorized where the target has a rounding insn. */
+    double n = rint(deg*(1.0/360.0)),
+           r = deg - 360.0*n, /* [-180, 180] */
+           a = fabs(r),
+           b = a > 90.0 ? 180.0 - a : a, /* [0, 90] */
+           x = b*(PI/180.0),
+           x2 = x*x,
+           sn, cs;
+
+    sn = -1.0/1307674368000.0;
+    sn = sn*x2 + 1.0/6227020800.0;
+    sn = sn*x2 - 1.0/39916800.0;
+    sn = sn*x2 + 1.0/362880.0;
+    sn = sn*x2 - 1.0/5040.0;
+    sn = sn*x2 + 1.0/120.0;
+    sn = sn*x2 - 1.0/6.0;
+    sn = (sn*x2 + 1.0)*x;
+
+    cs = 1.0/20922789888000.0;
+    cs = cs*x2 - 1.0/87178291200.0;
+    cs = cs*x2 + 1.0/479001600.0;
+    cs = cs*x2 - 1.0/3628800.0;
+    cs = cs*x2 + 1.0/40320.0;
+    cs = cs*x2 - 1.0/720.0;
+    cs = cs*x2 + 1.0/24.0;
+    cs = cs*x2 - 1.0/2.0;
+    cs = cs*x2 + 1.0;
+
+    *s = r < 0.0 ? -sn : sn;
+    *c = a > 90.0 ? -cs : cs;
+}
+
 /* Element wise waveform calculator
  *
  * record(stringout, "$(N):expr") {
@@ -77,11 +161,61 @@ double phase_wrap(double pha)
  * OUTB = [2,6,9]
  *
  * Note: To support longer expressions set FTA=CHAR and NOA<=100
+ *
+ * Expressions using only arithmetic, ^, and math functions
+ * (eg. SIN, SQRT, ATAN2, MIN) are compiled and evaluated for blocks
+ * of elements.  Others, eg. with := or ?:, use calcPerform()
+ * for each element.
+ */
+
+/* Compiled form of an expression without assignments or conditionals.
+ * Evaluated on blocks of WG_BLOCK elements instead of calcPerform()
+ * for each element.
  */
+#define WG_BLOCK 256u
+#define WG_MAXCODE 64u
+#define WG_MAXDEPTH 16u
+/* as calcPerform() */
+#define WG_PI 3.14159265358979323846
+
+enum wg_op {
+    WG_ARG,   /* push input (arg) */
+    WG_CONST, /* push val */
+    WG_MIN,   /* of arg values */
+    WG_MAX,
+    /* unary */
+    WG_NEG,
+    WG_ABS,
+    WG_SQRT,
+    WG_FN,    /* val = fn(val) */
+    /* binary */
+    WG_ADD,
+    WG_SUB,
+    WG_MUL,
+    WG_DIV,
+    WG_POW,
+    WG_ATAN2,
+};
+
+typedef struct {
+    enum wg_op op;
+    unsigned arg;
+    double val;
+    double (*fn)(double);
+} wg_insn;
+
+typedef struct {
+    wg_insn code[WG_MAXCODE];
+    unsigned ncode;
+} wg_prog;
 
 struct calcPriv {
     char prev[MAX_INFIX_SIZE];
     char postfix[MAX_POSTFIX_SIZE];
+    int compiled; /* use prog instead of postfix */
+    wg_prog prog;
+    double scratch[WG_MAXDEPTH][WG_BLOCK];
+    double argbuf[CALCPERFORM_NARGS][WG_BLOCK];
     double stack[CALCPERFORM_NARGS];
     epicsUInt32 usein, useout; // can be used
     unsigned long ins, outs;   // will be used
@@ -97,6 +231,374 @@ typedef struct calcPriv calcPriv;
 // must be enough bits to represent all arguments in 'usein' and 'useout'
 STATIC_ASSERT(sizeof(epicsUInt32)*8 >= CALCPERFORM_NARGS);
 
+/* Recursive descent compiler for a subset of the calc expression syntax.
+ * Anything else fails, and postfix is evaluated with calcPerform().
+ */
+typedef struct {
+    const char *pos;
+    wg_prog *prog;
+    unsigned depth, maxdepth;
+    int err;
+} wg_parser;
+
+static const struct {
+    const char *name;
+    enum wg_op op;
+    double (*fn)(double);
+} wg_funcs[] = {
+    {"ABS", WG_ABS, NULL},
+    {"SQRT", WG_SQRT, NULL},
+    {"SQR", WG_SQRT, NULL},
+    {"EXP", WG_FN, &exp},
+    {"LN", WG_FN, &log},
+    {"LOGE", WG_FN, &log},
+    {"LOG", WG_FN, &log10},
+    {"SIN", WG_FN, &sin},
+    {"COS", WG_FN, &cos},
+    {"TAN", WG_FN, &tan},
+    {"ASIN", WG_FN, &asin},
+    {"ACOS", WG_FN, &acos},
+    {"ATAN", WG_FN, &atan},
+    {"SINH", WG_FN, &sinh},
+    {"COSH", WG_FN, &cosh},
+    {"TANH", WG_FN, &tanh},
+    {"CEIL", WG_FN, &ceil},
+    {"FLOOR", WG_FN, &floor},
+    {"ATAN2", WG_ATAN2, NULL},
+    {"MIN", WG_MIN, NULL},
+    {"MAX", WG_MAX, NULL},
+};
+
+static void wg_expr(wg_parser *P);
+
+static
+void wg_emit(wg_parser *P, enum wg_op op, unsigned arg, double val, int push)
+{
+    wg_insn *insn;
+    if(P->err || P->prog->ncode==WG_MAXCODE) {
+        P->err = 1;
+        return;
+    }
+    insn = &P->prog->code[P->prog->ncode++];
+    insn->op = op;
+    insn->arg = arg;
+    insn->val = val;
+    insn->fn = NULL;
+
+    P->depth += push;
+    if(P->depth > WG_MAXDEPTH)
+        P->err = 1;
+    P->maxdepth = MAX(P->maxdepth, P->depth);
+}
+
+static
+void wg_skip(wg_parser *P)
+{
+    while(*P->pos==' ' || *P->pos=='\t')
+        P->pos++;
+}
+
+/* consume token if next */
+static
+int wg_accept(wg_parser *P, const char *tok)
+{
+    size_t len = strlen(tok);
+    wg_skip(P);
+    if(strncmp(P->pos, tok, len)!=0)
+        return 0;
+    P->pos += len;
+    return 1;
+}
+
+static
+void wg_primary(wg_parser *P)
+{
+    char name[8];
+    size_t len = 0, i;
+
+    wg_skip(P);
+
+    if((*P->pos>='0' && *P->pos<='9') || *P->pos=='.') {
+        char *end;
+        double val = strtod(P->pos, &end);
+        if(end==P->pos) {
+            P->err = 1;
+            return;
+        }
+        P->pos = end;
+        wg_emit(P, WG_CONST, 0, val, 1);
+        return;
+
+    } else if(wg_accept(P, "(")) {
+        wg_expr(P);
+        if(!wg_accept(P, ")"))
+            P->err = 1;
+        return;
+    }
+
+    while(len<sizeof(name)-1 && isalnum((unsigned char)P->pos[len])) {
+        name[len] = toupper((unsigned char)P->pos[len]);
+        len++;
+    }
+    name[len] = '\0';
+    if(len==0 || isalnum((unsigned char)P->pos[len])) {
+        P->err = 1;
+        return;
+    }
+    P->pos += len;
+
+    if(len==1 && name[0]>='A' && name[0]<'A'+CALCPERFORM_NARGS) {
+        wg_emit(P, WG_ARG, name[0]-'A', 0.0, 1);
+        return;
+    } else if(strcmp(name, "PI")==0) {
+        wg_emit(P, WG_CONST, 0, WG_PI, 1);
+        return;
+    } else if(strcmp(name, "D2R")==0) {
+        wg_emit(P, WG_CONST, 0, WG_PI/180.0, 1);
+        return;
+    } else if(strcmp(name, "R2D")==0) {
+        wg_emit(P, WG_CONST, 0, 180.0/WG_PI, 1);
+        return;
+    }
+
+    for(i=0; i<NELEMENTS(wg_funcs); i++) {
+        unsigned nargs = 0;
+
+        if(strcmp(name, wg_funcs[i].name)!=0)
+            continue;
+
+        if(!wg_accept(P, "(")) {
+            P->err = 1;
+            return;
+        }
+        do {
+            wg_expr(P);
+            nargs++;
+        } while(!P->err && wg_accept(P, ","));
+        if(!wg_accept(P, ")"))
+            P->err = 1;
+
+        if(wg_funcs[i].op==WG_MIN || wg_funcs[i].op==WG_MAX) {
+            wg_emit(P, wg_funcs[i].op, nargs, 0.0, 1-(int)nargs);
+        } else if(nargs!=(wg_funcs[i].op==WG_ATAN2 ? 2u : 1u)) {
+            P->err = 1;
+        } else {
+            wg_emit(P, wg_funcs[i].op, 0, 0.0, 1-(int)nargs);
+            if(!P->err)
+                P->prog->code[P->prog->ncode-1].fn = wg_funcs[i].fn;
+        }
+        return;
+    }
+
+    P->err = 1;
+}
+
+static
+void wg_unary(wg_parser *P)
+{
+    if(wg_accept(P, "-")) {
+        wg_unary(P);
+        wg_emit(P, WG_NEG, 0, 0.0, 0);
+    } else {
+        wg_primary(P);
+    }
+}
+
+static
+void wg_power(wg_parser *P)
+{
+    wg_unary(P);
+    while(!P->err) {
+        if(wg_accept(P, "**") || wg_accept(P, "^")) {
+            wg_unary(P);
+            wg_emit(P, WG_POW, 0, 0.0, -1);
+        } else {
+            break;
+        }
+    }
+}
+
+static
+void wg_term(wg_parser *P)
+{
+    wg_power(P);
+    while(!P->err) {
+        enum wg_op op;
+        wg_skip(P);
+        /* not '**' */
+        if(P->pos[0]=='*' && P->pos[1]!='*')
+            op = WG_MUL;
+        else if(P->pos[0]=='/')
+            op = WG_DIV;
+        else
+            break;
+        P->pos++;
+        wg_power(P);
+        wg_emit(P, op, 0, 0.0, -1);
+    }
+}
+
+static
+void wg_expr(wg_parser *P)
+{
+    wg_term(P);
+    while(!P->err) {
+        enum wg_op op;
+        if(wg_accept(P, "+"))
+            op = WG_ADD;
+        else if(wg_accept(P, "-"))
+            op = WG_SUB;
+        else
+            break;
+        wg_term(P);
+        wg_emit(P, op, 0, 0.0, -1);
+    }
+}
+
+/* evaluate prog for n elements of args.  Returns pointer to the result */
+static
+const double* wg_eval(const wg_prog *prog, double (*scratch)[WG_BLOCK],
+                      const double * const *args, size_t n)
+{
+    const double *stk[WG_MAXDEPTH];
+    unsigned pc, d = 0;
+    size_t i;
+
+    for(pc=0; pc<prog->ncode; pc++) {
+        const wg_insn *insn = &prog->code[pc];
+        double *out;
+        const double *a, *b;
+
+        switch(insn->op) {
+        case WG_ARG:
+            stk[d++] = args[insn->arg];
+            continue;
+        case WG_CONST:
+            out = scratch[d];
+            for(i=0; i<n; i++)
+                out[i] = insn->val;
+            stk[d++] = out;
+            continue;
+        case WG_MIN:
+        case WG_MAX:
+        {
+            /* as calcPerform(), NaN is returned if any argument is NaN */
+            unsigned j;
+            out = scratch[d-insn->arg];
+            b = stk[d-1];
+            for(j=2; j<=insn->arg; j++) {
+                a = stk[d-j];
+                /* args below d-j are not yet read, so only the last step
+                 * may write the result slot.  Accumulate in the top slot.
+                 */
+                out = scratch[j==insn->arg ? d-j : d-1];
+                if(insn->op==WG_MIN) {
+                    for(i=0; i<n; i++)
+                        out[i] = (a[i] > b[i] || isnan(b[i])) ? b[i] : a[i];
+                } else {
+                    for(i=0; i<n; i++)
+                        out[i] = (a[i] < b[i] || isnan(b[i])) ? b[i] : a[i];
+                }
+                b = out;
+            }
+            if(insn->arg==1u) {
+                for(i=0; i<n; i++)
+                    out[i] = b[i];
+            }
+            d -= insn->arg;
+            stk[d++] = out;
+            continue;
+        }
+        default:
+            break;
+        }
+
+        if(insn->op>=WG_NEG && insn->op<=WG_FN) {
+            /* unary */
+            a = stk[d-1];
+            out = scratch[d-1];
+            switch(insn->op) {
+            case WG_NEG:  for(i=0; i<n; i++) out[i] = -a[i]; break;
+            case WG_ABS:  for(i=0; i<n; i++) out[i] = fabs(a[i]); break;
+            case WG_SQRT: for(i=0; i<n; i++) out[i] = sqrt(a[i]); break;
+            case WG_FN:   for(i=0; i<n; i++) out[i] = insn->fn(a[i]); break;
+            default: break;
+            }
+            stk[d-1] = out;
+
+        } else {
+            /* binary */
+            a = stk[d-2];
+            b = stk[d-1];
+            out = scratch[d-2];
+            switch(insn->op) {
+            case WG_ADD: for(i=0; i<n; i++) out[i] = a[i] + b[i]; break;
+            case WG_SUB: for(i=0; i<n; i++) out[i] = a[i] - b[i]; break;
+            case WG_MUL: for(i=0; i<n; i++) out[i] = a[i] * b[i]; break;
+            case WG_DIV: for(i=0; i<n; i++) out[i] = a[i] / b[i]; break;
+            case WG_POW: for(i=0; i<n; i++) out[i] = pow(a[i], b[i]); break;
+            /* as calcPerform(), ATAN2(x, y) is atan2(y, x) */
+            case WG_ATAN2: for(i=0; i<n; i++) out[i] = atan2(b[i], a[i]); break;
+            default: break;
+            }
+            d--;
+            stk[d-1] = out;
+        }
+    }
+
+    return stk[0];
+}
+
+/* Compile, then compare with calcPerform() for some probe inputs.
+ * Returns non-zero if prog may be used.
+ */
+static
+int wg_compile(calcPriv *priv)
+{
+    wg_parser P;
+    const double *args[CALCPERFORM_NARGS];
+    const double *result;
+    size_t i, k;
+
+    memset(&P, 0, sizeof(P));
+    P.pos = priv->prev;
+    P.prog = &priv->prog;
+    priv->prog.ncode = 0;
+
+    if(priv->outs)
+        return 0; /* has assignment */
+
+    wg_expr(&P);
+    wg_skip(&P);
+    if(P.err || *P.pos!='\0' || P.depth!=1)
+        return 0;
+
+    /* probe values, some negative */
+    for(i=0; i<CALCPERFORM_NARGS; i++) {
+        for(k=0; k<4u; k++)
+            priv->argbuf[i][k] = (k&1 ? -1.0 : 1.0) * (0.37 + 0.61*i + 0.23*k);
+        args[i] = priv->argbuf[i];
+    }
+
+    result = wg_eval(&priv->prog, priv->scratch, args, 4u);
+
+    for(k=0; k<4u; k++) {
+        double stack[CALCPERFORM_NARGS], expect;
+
+        for(i=0; i<CALCPERFORM_NARGS; i++)
+            stack[i] = priv->argbuf[i][k];
+
+        if(calcPerform(stack, &expect, priv->postfix))
+            return 0;
+        /* same operations in the same order, so must match exactly */
+        if(isnan(expect) && isnan(result[k]))
+            continue;
+        if(expect!=result[k])
+            return 0;
+    }
+    return 1;
+}
+
 static
 long update_expr(aSubRecord* prec, calcPriv *priv)
 {
@@ -134,6 +636,8 @@ long update_expr(aSubRecord* prec, calcPriv *priv)
     val = priv->val & (priv->val-1); // clear lowest bit which is set
     priv->val = val ^ priv->val; // pick only lowest bit which is set
 
+    priv->compiled = wg_compile(priv);
+
     return 0;
 }
 
@@ -175,6 +679,73 @@ long init_waveform(aSubRecord* prec)
     return 0;
 }
 
+/* As gen_waveform(), with the compiled expression */
+static
+long gen_waveform_compiled(aSubRecord* prec, calcPriv* priv)
+{
+    size_t i, s, k;
+    epicsUInt32 nelem=0, nin=0;
+    const double *args[CALCPERFORM_NARGS];
+    const double *result = NULL;
+
+    for(i=0; i<CALCPERFORM_NARGS; ++i) {
+        nelem= MAX(nelem,(&prec->nova)[i]);
+        nin  = MAX(nin  ,(&prec->nea)[i]);
+    }
+    nelem = MIN(nelem, nin);
+
+    for(s=0; s<nelem; s+=WG_BLOCK) {
+        size_t n = MIN(WG_BLOCK, nelem-s);
+
+        for(i=0; i<CALCPERFORM_NARGS; ++i) {
+            const double *in = ((double**)&prec->a)[i];
+            epicsUInt32 nea = (&prec->nea)[i];
+            double *buf = priv->argbuf[i];
+
+            if(i==0 || !(priv->usein & (1<<i)) || nea==0) {
+                /* A is taken by the calc expression so use it to store PI */
+                double val = i==0 ? PI : 0.0;
+                for(k=0; k<n; k++)
+                    buf[k] = val;
+                args[i] = buf;
+
+            } else if(s+n <= nea) {
+                args[i] = in + s;
+
+            } else {
+                /* repeat last value */
+                for(k=0; k<n; k++)
+                    buf[k] = in[MIN(s+k, nea-1u)];
+                args[i] = buf;
+            }
+        }
+
+        result = wg_eval(&priv->prog, priv->scratch, args, n);
+
+        for(i=0; i<CALCPERFORM_NARGS; ++i) {
+            double *out = ((double**)&prec->vala)[i];
+            size_t nout = MIN(nelem, (&prec->nova)[i]);
+            const double *src = priv->val == (1<<i) ? result : args[i];
+
+            if(!(priv->useout & (1<<i)) || s >= nout)
+                continue;
+
+            memcpy(out+s, src, MIN(n, nout-s)*sizeof(*out));
+        }
+    }
+
+    if(result)
+        prec->udf = isnan(result[(nelem-1u)%WG_BLOCK]);
+
+    for(i=0; i<CALCPERFORM_NARGS; ++i) {
+        if(!(priv->useout & (1<<i)))
+            continue;
+        (&prec->neva)[i] = MIN( nelem, (&prec->nova)[i]);
+    }
+
+    return 0;
+}
+
 static
 long gen_waveform(aSubRecord* prec)
 {
@@ -192,6 +763,9 @@ long gen_waveform(aSubRecord* prec)
         return -1;
     }
 
+    if(priv->compiled)
+        return gen_waveform_compiled(prec, priv);
+
     // reset stack
     memset(&priv->stack, 0, sizeof(priv->stack));
 
@@ -257,6 +831,53 @@ long gen_waveform(aSubRecord* prec)
     return 0;
 }
 
+/* Element loops shared by IQ2AP and IQ2AP Stats.
+ * Separate loops without branches, which the compiler may vectorize
+ */
+static
+void iq2ap_amp(const double *I, const double *Q, double *A, size_t len)
+{
+    size_t i;
+    for(i=0; i<len; i++) {
+        A[i] = sqrt(I[i]*I[i] + Q[i]*Q[i]);
+    }
+}
+
+static
+void iq2ap_pha(const double *I, const double *Q, double *P, size_t len,
+               double zero_angle, unsigned fast)
+{
+    size_t i;
+    if(fast) {
+        /* atan2_fast() is in [-180, 180], so the sum is in [-360, 360) */
+        zero_angle = phase_wrap(zero_angle);
+        for(i=0; i<len; i++) {
+            P[i] = phase_wrap_fast(atan2_fast(Q[i], I[i]) * (180.0 / PI) + zero_angle);
+        }
+    } else {
+        for(i=0; i<len; i++) {
+            P[i] = atan2(Q[i], I[i]) * 180 / PI;
+            P[i] = phase_wrap(P[i] + zero_angle);
+        }
+    }
+}
+
+static
+void iq2ap_pow(const double *A, double *PW, size_t len,
+               double pow_scale, unsigned pow_special)
+{
+    size_t i;
+    for(i=0; i<len; i++) {
+        PW[i] = pow_scale * A[i] * A[i];
+    }
+    /* Not great special handling to convert watts to dBm */
+    if (pow_special) {
+        for(i=0; i<len; i++) {
+            PW[i] = 10 * log10(PW[i]*1000);
+        }
+    }
+}
+
 /* I/Q to amplitude/phase converter.
  * Also provide amplitude squared (power)
  *
@@ -283,6 +904,9 @@ long gen_waveform(aSubRecord* prec)
  *    be applied after linear scaling
  *    constant, default is 0, 1 = watts->dBm
  *  field(INPF, "PWRCONV")
+ *  # INPG is precision mode.  default is 0, exact.  1 = fast phase
+ *    with max. error 1e-6 deg.
+ *  field(INPG, "FAST")
  *  field(OUTA, "AMP PP")
  *  field(OUTB, "PHA PP") # in degrees
  *  field(OUTC, "POW PP") # AMP squared and/or additional conversion (Optional)
@@ -302,6 +926,7 @@ long convert_iq2ap(aSubRecord* prec)
     unsigned rot_out = prec->ftvd==menuFtypeDOUBLE && prec->ftve==menuFtypeDOUBLE;
     double pow_scale = 1.0, zero_angle = 0.0, disp_angle = 0.0;
     unsigned pow_special = 0; /* Flag for additional conversion after linear scaling */
+    unsigned fast = 0;
 
     double *I = (double*)prec->a,
            *Q = (double*)prec->b,
@@ -339,6 +964,10 @@ long convert_iq2ap(aSubRecord* prec)
         pow_special = *(double*)prec->f;
     }
 
+    if(prec->ftg==menuFtypeDOUBLE) {
+        fast = *(double*)prec->g;
+    }
+
     if(len > prec->neb)
         len = prec->neb;
     if(len > prec->nova)
@@ -352,19 +981,19 @@ long convert_iq2ap(aSubRecord* prec)
     if(rot_out && len > prec->nove)
         len = prec->nove;
 
-    for(i=0; i<len; i++) {
-        A[i] = sqrt(I[i]*I[i] + Q[i]*Q[i]);
-        P[i] = atan2(Q[i], I[i]) * 180 / PI;
-        P[i] = phase_wrap(P[i] + zero_angle);
-        if(PW) {
-            PW[i] = pow_scale * A[i] * A[i];
-            /* Not great special handling to convert watts to dBm */
-            if (pow_special)
-                PW[i] = 10 * log10(PW[i]*1000);
-		}
-        if(rot_out) {
-            IROT[i] = I[i]*cos(disp_angle) + Q[i]*sin(disp_angle);
-            QROT[i] = - I[i]*sin(disp_angle) + Q[i]*cos(disp_angle);
+    iq2ap_amp(I, Q, A, len);
+    iq2ap_pha(I, Q, P, len, zero_angle, fast);
+
+    if(PW) {
+        iq2ap_pow(A, PW, len, pow_scale, pow_special);
+    }
+
+    if(rot_out) {
+        double cos_disp = cos(disp_angle),
+               sin_disp = sin(disp_angle);
+        for(i=0; i<len; i++) {
+            IROT[i] = I[i]*cos_disp + Q[i]*sin_disp;
+            QROT[i] = - I[i]*sin_disp + Q[i]*cos_disp;
         }
     }
 
@@ -451,11 +1080,144 @@ long convert_ap2iq(aSubRecord* prec)
     return 0;
 }
 
+/* Windowed statistics shared by Wf Stats and IQ2AP Stats */
+
+/* order of outputs */
+enum {STAT_MEAN, STAT_STD, STAT_MIN, STAT_MAX, STAT_RSTD, STAT_RANGE, STAT_RMS, NSTATS};
+
+/* Sums are of (x - shift), with shift the first sample, if finite.
+ * Avoids loss of precision in <x^2> - <x>^2 with a large offset.
+ * As before, min/max are seeded by the first sample,
+ * then NaN samples are skipped (comparison is false).
+ */
+typedef struct {
+    double shift, sum, sum2, min, max;
+    size_t N;
+} stats_acc;
+
+static
+void stats_init(stats_acc *acc)
+{
+    acc->shift = acc->sum = acc->sum2 = 0.0;
+    acc->min = acc->max = epicsNAN;
+    acc->N = 0;
+}
+
+static
+void stats_add(stats_acc *acc, const double *data, size_t len)
+{
+    size_t i;
+    double shift, sum = acc->sum, sum2 = acc->sum2, min, max;
+
+    if(len==0)
+        return;
+
+    if(acc->N==0) {
+        acc->shift = isfinite(data[0]) ? data[0] : 0.0;
+        acc->min = acc->max = data[0];
+    }
+    shift = acc->shift;
+    min = acc->min;
+    max = acc->max;
+
+    for(i=0; i<len; i++) {
+        double d = data[i] - shift;
+
+        min = min > data[i] ? data[i] : min;
+        max = max < data[i] ? data[i] : max;
+
+        sum  += d;
+        sum2 += d * d;
+    }
+
+    acc->sum = sum;
+    acc->sum2 = sum2;
+    acc->min = min;
+    acc->max = max;
+    acc->N += len;
+}
+
+/* Index of first element of time >= val, or len.
+ * time must be non-decreasing.  Guess assuming uniform
+ * spacing (eg. from asub_feed_timebase), then binary search if wrong.
+ */
+static
+size_t time_index(const double *time, size_t len, double val)
+{
+    size_t lo = 0, hi = len;
+
+    if(len>1) {
+        double step = (time[len-1] - time[0]) / (len-1),
+               guess = ceil((val - time[0]) / step);
+        if(step > 0.0 && guess >= 0.0 && guess <= (double)len) {
+            size_t i = (size_t)guess;
+            if((i==0 || time[i-1] < val) && (i==len || time[i] >= val))
+                return i;
+        }
+    }
+
+    while(lo < hi) {
+        size_t mid = lo + (hi-lo)/2;
+        if(time[mid] < val)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Find elements with time in [start, end) */
+static
+void stats_window(const double *time, size_t len, double start, double end,
+                  size_t *first, size_t *last)
+{
+    *first = time_index(time, len, start);
+    *last = MAX(*first, time_index(time, len, end));
+}
+
+/* Call with acc->N > 0 */
+static
+void stats_result(const stats_acc *acc, unsigned phamod, double *result)
+{
+    double dmean = acc->sum  / acc->N, // <x - shift>
+           var   = acc->sum2 / acc->N - dmean*dmean,
+           mean  = acc->shift + dmean, // <x>
+           min   = acc->min,
+           max   = acc->max;
+
+    var = MAX(var, 0.0); /* round off */
+
+    result[STAT_STD] = sqrt(var);
+    result[STAT_RMS] = sqrt(var + mean*mean);
+
+    if(phamod) {
+        /* (re)wrap as phase.
+         * Only min/max/mean, not sure how to wrap std meaningfully.
+         */
+        mean = phase_wrap(mean);
+        min = phase_wrap(min);
+        max = phase_wrap(max);
+        if(max < min) {
+            /* make sure we don't confuse users if max wraps to less than min */
+            double temp = min;
+            min = max;
+            max = temp;
+        }
+    }
+
+    result[STAT_MEAN] = mean;
+    result[STAT_MIN] = min;
+    result[STAT_MAX] = max;
+    result[STAT_RSTD] = result[STAT_STD] / fabs(mean);
+    result[STAT_RANGE] = max - min;
+}
+
 /* Waveform statistics
  *
  * Computes mean and std of the (subset of)
  * waveform Y.  The values of waveform X
- * (aka time) are used to compute the windows
+ * (aka time) are used to compute the windows.
+ * X must be non-decreasing.
  *
  * record(aSub, "$(N)") {
  *  field(SNAM, "Wf Stats")
@@ -487,7 +1249,7 @@ long convert_ap2iq(aSubRecord* prec)
 static
 long wf_stats(aSubRecord* prec)
 {
-    size_t i, N=0;
+    size_t i, first, last;
     epicsEnum16 *ft = &prec->fta,
                 *ftv= &prec->ftva;
     epicsUInt32 phamod = prec->fte==menuFtypeLONG ? *(epicsUInt32*)prec->e : 0;
@@ -496,11 +1258,10 @@ long wf_stats(aSubRecord* prec)
 
     double *data = prec->a,
             *time = prec->b,
-            sum   = 0.0,
-            sum2  = 0.0,
             start = *(double*)prec->c,
             width = *(double*)prec->d;
-    double  min = epicsNAN, max = epicsNAN;
+    double result[NSTATS];
+    stats_acc acc;
 
 
     if(prec->dpvt==BADMAGIC) {
@@ -536,60 +1297,462 @@ long wf_stats(aSubRecord* prec)
         return 0;
     }
 
-    for(i=0; i<len; i++) {
-        if(time[i]<start)
-            continue;
-        if(time[i]>=start+width)
-            break;
+    stats_window(time, len, start, start+width, &first, &last);
+
+    stats_init(&acc);
+    stats_add(&acc, data+first, last-first);
+
+    if(acc.N==0) {
+        recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
+        return 0;
+    }
+
+    stats_result(&acc, phamod, result);
+
+    for(i=0; i<NSTATS; i++) {
+        *(double*)(&prec->vala)[i] = result[i];
+        (&prec->neva)[i] = 1;
+    }
+
+    return 0;
+}
+
+/* Fused I/Q to amplitude/phase converter and waveform statistics.
+ *
+ * Equivalent to IQ2AP followed by Wf Stats of both amplitude and phase,
+ * in one pass over the inputs.
+ * Each output is computed only when its FTV is DOUBLE.
+ * Set eg. FTVC to "CHAR" to disable.
+ *
+ * record(aSub, "$(N)") {
+ *  field(SNAM, "IQ2AP Stats")
+ *  field(FTVC ,"CHAR") # disable power
+ *  field(NOA , "128")
+ *  field(NOB , "128")
+ *  field(NOG , "128")
+ *  field(NOVA, "128")
+ *  field(NOVB, "128")
+ *  field(INPA, "I")
+ *  field(INPB, "Q")
+ *  field(INPC, "POWSCALE") # as IQ2AP
+ *  field(INPD, "ZRANGLE")
+ *  field(INPE, "PWRCONV")
+ *  field(INPF, "FAST")
+ *  field(INPG, "Waveform X") # as Wf Stats
+ *  field(INPH, "Start X")
+ *  field(INPI, "Width X")
+ *  field(OUTA, "AMP PP")
+ *  field(OUTB, "PHA PP")
+ *  field(OUTC, "POW PP")
+ *  # amplitude statistics
+ *  field(OUTD, "AMP:MEAN PP")
+ *  field(OUTE, "AMP:STD PP")
+ *  field(OUTF, "AMP:MIN PP")
+ *  field(OUTG, "AMP:MAX PP")
+ *  field(OUTH, "AMP:RSTD PP")
+ *  field(OUTI, "AMP:RANGE PP")
+ *  field(OUTJ, "AMP:RMS PP")
+ *  # phase statistics, as Wf Stats with isphase=1
+ *  field(OUTK, "PHA:MEAN PP")
+ *  field(OUTL, "PHA:STD PP")
+ *  field(OUTM, "PHA:MIN PP")
+ *  field(OUTN, "PHA:MAX PP")
+ *  field(OUTO, "PHA:RSTD PP")
+ *  field(OUTP, "PHA:RANGE PP")
+ *  field(OUTQ, "PHA:RMS PP")
+ * }
+ */
+
+/* Elements processed together.  Intermediates stay in L1 cache. */
+#define IQ2AP_BLOCK 256u
+
+static
+long iq2ap_stats(aSubRecord* prec)
+{
+    size_t i, b, first = 0, last = 0;
+    epicsEnum16 *ftv = &prec->ftva;
+    epicsUInt32 *nov = &prec->nova;
+    epicsUInt32 len = MIN(prec->nea, prec->neb);
+    double pow_scale = 1.0, zero_angle = 0.0, start = 0.0, end = 0.0;
+    unsigned pow_special = 0, fast = 0;
+    unsigned amp_out = ftv[0]==menuFtypeDOUBLE,
+             pha_out = ftv[1]==menuFtypeDOUBLE,
+             pow_out = ftv[2]==menuFtypeDOUBLE,
+             amp_stats = 0, pha_stats = 0;
+    stats_acc amp_acc, pha_acc;
+    double abuf[IQ2AP_BLOCK], pbuf[IQ2AP_BLOCK];
+
+    double *I = (double*)prec->a,
+           *Q = (double*)prec->b,
+           *time = (double*)prec->g;
+
+    for(i=0; i<NSTATS; i++) {
+        amp_stats |= ftv[3+i]==menuFtypeDOUBLE;
+        pha_stats |= ftv[3+NSTATS+i]==menuFtypeDOUBLE;
+    }
+
+    if(prec->fta!=menuFtypeDOUBLE
+            || prec->ftb!=menuFtypeDOUBLE
+            || ((amp_stats || pha_stats) && (prec->ftg!=menuFtypeDOUBLE
+                                            || prec->fth!=menuFtypeDOUBLE
+                                            || prec->fti!=menuFtypeDOUBLE)))
+    {
+        (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+        return 1;
+    }
+
+    if(prec->ftc==menuFtypeDOUBLE) {
+        pow_scale = *(double*)prec->c;
+    }
+    if(pow_scale==0.0) {
+        pow_scale = 1.0;
+    }
+
+    if(prec->ftd==menuFtypeDOUBLE) {
+        zero_angle = *(double*)prec->d;
+    }
+
+    if(prec->fte==menuFtypeDOUBLE) {
+        pow_special = *(double*)prec->e;
+    }
+
+    if(prec->ftf==menuFtypeDOUBLE) {
+        fast = *(double*)prec->f;
+    }
+
+    if(amp_stats || pha_stats) {
+        start = *(double*)prec->h;
+        end = start + *(double*)prec->i;
+        if(len > prec->neg)
+            len = prec->neg;
+    }
+
+    for(i=0; i<3; i++) {
+        if(ftv[i]==menuFtypeDOUBLE && len > nov[i])
+            len = nov[i];
+    }
+
+    if(amp_stats || pha_stats)
+        stats_window(time, len, start, end, &first, &last);
+
+    stats_init(&amp_acc);
+    stats_init(&pha_acc);
+
+    for(b=0; b<len; b+=IQ2AP_BLOCK) {
+        size_t n = MIN(IQ2AP_BLOCK, len-b);
+        double *A = amp_out ? (double*)prec->vala + b : abuf,
+               *P = pha_out ? (double*)prec->valb + b : pbuf;
+
+        if(amp_out || amp_stats || pow_out)
+            iq2ap_amp(I+b, Q+b, A, n);
+        if(pha_out || pha_stats)
+            iq2ap_pha(I+b, Q+b, P, n, zero_angle, fast);
+
+        if(pow_out)
+            iq2ap_pow(A, (double*)prec->valc + b, n, pow_scale, pow_special);
+
+        if(first < b+n && last > b) {
+            /* part of block in window */
+            size_t lo = MAX(first, b) - b,
+                   hi = MIN(last, b+n) - b;
+            if(amp_stats)
+                stats_add(&amp_acc, A+lo, hi-lo);
+            if(pha_stats)
+                stats_add(&pha_acc, P+lo, hi-lo);
+        }
+    }
+
+    if(amp_out)
+        prec->neva = len;
+    if(pha_out)
+        prec->nevb = len;
+    if(pow_out)
+        prec->nevc = len;
+
+    if(amp_stats || pha_stats) {
+        double result[NSTATS];
+        unsigned g;
+
+        /* same window for both */
+        if((amp_stats ? amp_acc.N : pha_acc.N)==0) {
+            recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
+            return 0;
+        }
+
+        /* amplitude, then phase */
+        for(g=0; g<2; g++) {
+            size_t out = 3 + g*NSTATS;
+
+            if(!(g ? pha_stats : amp_stats))
+                continue;
+
+            stats_result(g ? &pha_acc : &amp_acc, g, result);
+
+            for(i=0; i<NSTATS; i++) {
+                if(ftv[out+i]!=menuFtypeDOUBLE)
+                    continue;
+                *(double*)(&prec->vala)[out+i] = result[i];
+                (&prec->neva)[out+i] = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Statistics of several windows of one waveform
+ *
+ * As Wf Stats, with arrays of window start and width.
+ * Each output is an array with one element per window.
+ * Empty windows give NaN.  Each output is computed only
+ * when its FTV is DOUBLE.
+ *
+ * With many, or overlapping, windows, prefix sums of the waveform
+ * are computed once and each window costs ~ NOA/64 operations.
+ * Then std of a long window with small variance, in a waveform with
+ * large variance, has round off error of ~1e-8 of the waveform std.
+ *
+ * record(aSub, "$(N)") {
+ *  field(INAM, "Wf Stats Multi Init")
+ *  field(SNAM, "Wf Stats Multi")
+ *  field(FTE , "LONG")
+ *  field(NOA , "128")
+ *  field(NOB , "128")
+ *  field(NOC , "4") # max. number of windows
+ *  field(NOD , "4")
+ *  field(NOVA, "4")
+ *  field(NOVB, "4")
+ *  field(NOVC, "4")
+ *  field(NOVD, "4")
+ *  field(FTVE, "CHAR") # disable RSTD
+ *  field(FTVF, "CHAR") # disable RANGE
+ *  field(FTVG, "CHAR") # disable RMS
+ *  field(INPA, "Waveform Y")
+ *  field(INPB, "Waveform X")
+ *  field(INPC, "Start X") # array of window start
+ *  field(INPD, "Width X") # array of window width
+ *  field(INPE, "isphase")  # optional, 1 - output modulo +-180
+ *  field(OUTA, "MEAN PP")
+ *  field(OUTB, "STD PP")
+ *  field(OUTC, "MIN PP")
+ *  field(OUTD, "MAX PP")
+ *  field(OUTE, "RSTD PP")
+ *  field(OUTF, "RANGE PP")
+ *  field(OUTG, "RMS PP")
+ * }
+ */
+
+#define STATS_BLOCK 64u
+
+typedef struct {
+    /* bounds of each window.  MIN(NOC, NOD) elements */
+    size_t *first, *last;
+    /* prefix sums of (x - shift).  MIN(NOA, NOB)+1 elements */
+    double *psum, *psum2;
+    /* min/max of each STATS_BLOCK elements */
+    double *bmin, *bmax;
+} statsMultiPriv;
+
+static
+long init_wf_stats_multi(aSubRecord* prec)
+{
+    size_t i, maxlen, maxwin, nblocks;
+    statsMultiPriv *priv;
 
-        if(min > data[i] || N==0)
-            min = data[i];
-        if(max < data[i] || N==0)
-            max = data[i];
+    for(i=0; i<4; i++) {
+        if((&prec->fta)[i]!=menuFtypeDOUBLE) {
+            errlogPrintf("%s: FT%c must be DOUBLE\n",
+                         prec->name, 'A'+(char)i);
+            (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+            return -1;
+        }
+    }
+
+    priv = calloc(1, sizeof(statsMultiPriv));
+    if(!priv) {
+        (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+        return -1;
+    }
+
+    maxlen = MIN(prec->noa, prec->nob);
+    maxwin = MIN(prec->noc, prec->nod);
+    nblocks = maxlen/STATS_BLOCK + 1;
+
+    priv->first = calloc(maxwin, sizeof(size_t));
+    priv->last  = calloc(maxwin, sizeof(size_t));
+    priv->psum  = calloc(maxlen+1, sizeof(double));
+    priv->psum2 = calloc(maxlen+1, sizeof(double));
+    priv->bmin  = calloc(nblocks, sizeof(double));
+    priv->bmax  = calloc(nblocks, sizeof(double));
+    if(!priv->first || !priv->last || !priv->psum || !priv->psum2
+            || !priv->bmin || !priv->bmax) {
+        free(priv->first);
+        free(priv->last);
+        free(priv->psum);
+        free(priv->psum2);
+        free(priv->bmin);
+        free(priv->bmax);
+        free(priv);
+        (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+        return -1;
+    }
+
+    prec->dpvt = priv;
+    return 0;
+}
 
-        sum  += data[i];
-        sum2 += data[i] * data[i];
-        N++;
+/* min/max of data[first, last) using block min/max */
+static
+void stats_block_minmax(const statsMultiPriv *priv, const double *data,
+                        size_t first, size_t last, double *pmin, double *pmax)
+{
+    size_t i,
+           b0 = (first + STATS_BLOCK - 1)/STATS_BLOCK, /* first whole block */
+           b1 = last/STATS_BLOCK; /* after last whole block */
+    double min = data[first], max = data[first];
+
+    if(b0 >= b1) {
+        for(i=first; i<last; i++) {
+            min = min > data[i] ? data[i] : min;
+            max = max < data[i] ? data[i] : max;
+        }
+    } else {
+        for(i=first; i<b0*STATS_BLOCK; i++) {
+            min = min > data[i] ? data[i] : min;
+            max = max < data[i] ? data[i] : max;
+        }
+        for(i=b0; i<b1; i++) {
+            min = min > priv->bmin[i] ? priv->bmin[i] : min;
+            max = max < priv->bmax[i] ? priv->bmax[i] : max;
+        }
+        for(i=b1*STATS_BLOCK; i<last; i++) {
+            min = min > data[i] ? data[i] : min;
+            max = max < data[i] ? data[i] : max;
+        }
     }
 
-    if(N==0) {
+    *pmin = min;
+    *pmax = max;
+}
+
+static
+long wf_stats_multi(aSubRecord* prec)
+{
+    size_t i, w, nwin, total = 0, nempty = 0;
+    epicsEnum16 *ftv = &prec->ftva;
+    epicsUInt32 *nov = &prec->nova;
+    statsMultiPriv *priv = prec->dpvt;
+    epicsUInt32 phamod = prec->fte==menuFtypeLONG ? *(epicsUInt32*)prec->e : 0;
+    epicsUInt32 len = MIN(prec->nea, prec->neb);
+    unsigned use_prefix;
+    double shift;
+
+    double *data  = (double*)prec->a,
+           *time  = (double*)prec->b,
+           *start = (double*)prec->c,
+           *width = (double*)prec->d;
+
+    if(!priv) {
+        (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+        errlogPrintf("%s: Not initialized\n", prec->name);
+        return 1;
+    }
+
+    nwin = MIN(prec->nec, prec->ned);
+    for(i=0; i<NSTATS; i++) {
+        if(ftv[i]==menuFtypeDOUBLE)
+            nwin = MIN(nwin, nov[i]);
+    }
+
+    if(len==0 || nwin==0) {
         recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
         return 0;
     }
 
-    sum  /= N; // <x>
-    sum2 /= N; // <x^2>
+    for(w=0; w<nwin; w++) {
+        stats_window(time, len, start[w], start[w]+width[w],
+                     &priv->first[w], &priv->last[w]);
+        total += priv->last[w] - priv->first[w];
+    }
 
-    *(double*)prec->vala = sum;
-    prec->neva=1;
-    *(double*)prec->valb = sqrt(sum2 - sum*sum);
-    prec->nevb=1;
+    /* prefix sums cost one pass, plus ~ len/STATS_BLOCK per window.
+     * Otherwise visit each window directly.
+     */
+    use_prefix = total > 2u*len;
+
+    shift = isfinite(data[0]) ? data[0] : 0.0;
+    if(use_prefix) {
+        double sum = 0.0, sum2 = 0.0;
+
+        priv->psum[0] = priv->psum2[0] = 0.0;
+        for(i=0; i<len; i++) {
+            double d = data[i] - shift;
+            sum  += d;
+            sum2 += d * d;
+            priv->psum[i+1] = sum;
+            priv->psum2[i+1] = sum2;
+        }
 
-    if(phamod) {
-        /* (re)wrap as phase.
-         * Only min/max/mean, not sure how to wrap std meaningfully.
+        /* An inf or NaN sample (eg. -inf dBm) makes every later prefix
+         * non-finite, including for windows without it.  Visit each
+         * window directly instead.
          */
-        *(double*)prec->vala = phase_wrap(*(double*)prec->vala);
-        min = phase_wrap(min);
-        max = phase_wrap(max);
-        if(max < min) {
-            /* make sure we don't confuse users if max wraps to less than min */
-            double temp = min;
-            min = max;
-            max = temp;
+        if(!isfinite(sum) || !isfinite(sum2))
+            use_prefix = 0;
+    }
+
+    if(use_prefix) {
+        for(i=0; i*STATS_BLOCK < len; i++) {
+            size_t j, end = MIN(len, (i+1)*STATS_BLOCK);
+            double min = INFINITY, max = -INFINITY;
+            for(j=i*STATS_BLOCK; j<end; j++) {
+                min = min > data[j] ? data[j] : min;
+                max = max < data[j] ? data[j] : max;
+            }
+            priv->bmin[i] = min;
+            priv->bmax[i] = max;
         }
     }
 
-    *(double*)prec->valc = min;
-    prec->nevc=1;
-    *(double*)prec->vald = max;
-    prec->nevd=1;
-    *(double*)prec->vale = *(double*)prec->valb / fabs(*(double*)prec->vala);
-    prec->neve=1;
-    *(double*)prec->valf = max - min;
-    prec->nevf=1;
-    *(double*)prec->valg = sqrt(sum2);
-    prec->nevg=1;
+    for(w=0; w<nwin; w++) {
+        size_t first = priv->first[w], last = priv->last[w];
+        double result[NSTATS];
+        stats_acc acc;
+
+        stats_init(&acc);
+
+        if(first==last) {
+            for(i=0; i<NSTATS; i++)
+                result[i] = epicsNAN;
+            nempty++;
+
+        } else {
+            /* short windows are cheaper, and more precise, directly */
+            if(use_prefix && last - first > 2u*STATS_BLOCK) {
+                acc.shift = shift;
+                acc.sum   = priv->psum[last]  - priv->psum[first];
+                acc.sum2  = priv->psum2[last] - priv->psum2[first];
+                acc.N     = last - first;
+                stats_block_minmax(priv, data, first, last, &acc.min, &acc.max);
+            } else {
+                stats_add(&acc, data+first, last-first);
+            }
+            stats_result(&acc, phamod, result);
+        }
+
+        for(i=0; i<NSTATS; i++) {
+            if(ftv[i]==menuFtypeDOUBLE)
+                ((double*)(&prec->vala)[i])[w] = result[i];
+        }
+    }
+
+    for(i=0; i<NSTATS; i++) {
+        if(ftv[i]==menuFtypeDOUBLE)
+            (&prec->neva)[i] = nwin;
+    }
+
+    if(nempty==nwin)
+        recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
 
     return 0;
 }
@@ -597,17 +1760,25 @@ long wf_stats(aSubRecord* prec)
 /* Unwrap phase
  *
  * Takes a phase signal which may be wrapped around [-180, 180].
- * Unwrap for jumps where the unwrapped phase would not change
+ * In mode 0, unwrap for jumps where the unwrapped phase would not change
  * by more then Max Difference degrees between samples.
  *
+ * In mode 1, unwrap any jump of more than 180 degrees between samples
+ * (Itoh's method, as numpy.unwrap() ).  If Continue is non-zero, the first
+ * sample is unwrapped relative to VALB, the last output of the previous
+ * call, so that phase is tracked across waveforms.  Write 0 to VALB to restart.
+ *
  * record(aSub, "$(N)") {
  *  field(SNAM, "Phase Unwrap")
  *  field(FTA , "DOUBLE")
  *  field(NOA , "128")
  *  field(NOVA, "128")
  *  field(INPA, "Wrapped phase")
- *  field(INPB, "Max Difference")
+ *  field(INPB, "Max Difference") # mode 0 only
+ *  field(INPC, "Mode")     # default 0, 1 = Itoh
+ *  field(INPD, "Continue") # mode 1 only.  default 0
  *  field(OUTA, "Unwrapped phase PP")
+ *  field(OUTB, "Last unwrapped phase PP") # (Optional)
  */
 
 static
@@ -616,7 +1787,9 @@ long unwrap(aSubRecord* prec)
     size_t i;
     double *in = (double*)prec->a,
             *out= (double*)prec->vala,
-            thres;
+            *last = NULL,
+            thres, prev;
+    unsigned itoh = 0, cont = 0;
     epicsUInt32 len=MIN(prec->nea, prec->nova);
 
     if(prec->dpvt==BADMAGIC) {
@@ -644,10 +1817,58 @@ long unwrap(aSubRecord* prec)
         prec->dpvt = MAGIC;
     }
 
-    if(len==0 || prec->neb==0) {
+    if(prec->ftc==menuFtypeDOUBLE && prec->nec) {
+        itoh = *(double*)prec->c;
+    }
+    if(prec->ftd==menuFtypeDOUBLE && prec->ned) {
+        cont = *(double*)prec->d;
+    }
+
+    /* Max Difference (B) is only used by mode 0 */
+    if(len==0 || (!itoh && prec->neb==0)) {
         recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
         return 0;
     }
+    if(prec->ftvb==menuFtypeDOUBLE && prec->novb) {
+        last = (double*)prec->valb;
+    }
+
+    if(itoh) {
+        /* out = in + 360 * cumulative number of turns.
+         * Rounding to the nearest turn is done by rint(), without
+         * branches, so this loop may be vectorized.
+         * Differences of exactly 180 round to even, and are not corrected.
+         * NaN samples pass through without disturbing later corrections.
+         */
+        for(i=1; i<len; i++) {
+            double d = in[i] - in[i-1],
+                   n = rint(d/360.0);
+            out[i] = n==n ? -360.0*n : 0.0;
+        }
+
+        /* starting from 0.0 is the same as not continuing */
+        prev = (cont && last && !isnan(*last)) ? *last : 0.0;
+        {
+            double d = in[0] - prev,
+                   n = rint(d/360.0),
+                   turns = n==n ? -360.0*n : 0.0;
+
+            out[0] = in[0] + turns;
+            for(i=1; i<len; i++) {
+                turns += out[i];
+                out[i] = in[i] + turns;
+            }
+        }
+
+        if(last) {
+            *last = out[len-1];
+            prec->nevb = 1;
+        }
+
+        prec->neva = len;
+        return 0;
+    }
+
     thres = *(double*)prec->b;
     thres /= 2.0; // half on either side of the fold
 
@@ -674,7 +1895,12 @@ long unwrap(aSubRecord* prec)
     return 0;
 }
 
-/* Calculate PI controller output */
+/* Calculate PI controller output
+ *
+ * INPA phase offset (deg.), INPB/C DAC I/Q, INPD cavity phase (deg.), INPE gain.
+ * INPF is precision mode.  default is 0, exact.  1 = fast sin/cos/atan2
+ * with max. error 1e-6 deg.
+ */
 static
 long calc_ctrl(aSubRecord* prec)
 {
@@ -683,6 +1909,7 @@ long calc_ctrl(aSubRecord* prec)
 	size_t i;
 	epicsUInt32 len = prec->neb; /* actual output length */
 	double poff = 0.0, gain = 1.0;
+	unsigned fast = 0;
 
 	double *DACI = (double*)prec->b,
 		*DACQ  = (double*)prec->c,
@@ -716,6 +1943,10 @@ long calc_ctrl(aSubRecord* prec)
 		gain = *(double*)prec->e;
 	}
 
+	if(prec->ftf==menuFtypeDOUBLE) {
+		fast = *(double*)prec->f;
+	}
+
 	epicsTimeStamp daci, dacq, cavp;
 	double t1, t2;
     dbGetTimeStamp(&prec->inpb, &daci);
@@ -731,7 +1962,6 @@ long calc_ctrl(aSubRecord* prec)
         /* Do not process outputs */
         return -1;
     }
-	double rot = 0.0;
 
 	if(len > prec->nec)
 		len = prec->nec;
@@ -750,17 +1980,55 @@ long calc_ctrl(aSubRecord* prec)
 	if(len > prec->novf)
 		len = prec->novf;
 
+	/* Separate loops without branches, which the compiler may vectorize.
+	 * Each reads and writes few enough arrays for the compiler's aliasing checks.
+	 * cos(-rot) == cos(rot) and sin(-rot) == -sin(rot), so each is computed once.
+	 */
 	for(i=0; i<len; i++) {
 		ROTP[i] = CAVP[i] - poff;
-		rot = (ROTP[i])* PI/180; 
-		CTRLI[i] = (DACI[i]*cos(-rot) - DACQ[i]*sin(-rot))*gain;
-		CTRLQ[i] = -((DACI[i]*sin(-rot) + DACQ[i]*cos(-rot))*gain);
-        CTRLP[i] = atan2(CTRLQ[i], CTRLI[i]) * 180 / PI;
-        CTRLA[i] = sqrt(pow(CTRLI[i],2) + pow(CTRLQ[i],2));
-        DACP[i] = atan2(DACQ[i], DACI[i]) * 180 / PI;
-        if ( debug ) {
+	}
+
+	if(fast) {
+		for(i=0; i<len; i++) {
+			double s, c;
+			sincos_fast(ROTP[i], &s, &c);
+			CTRLI[i] = (DACI[i]*c + DACQ[i]*s)*gain;
+			CTRLQ[i] = (DACI[i]*s - DACQ[i]*c)*gain;
+		}
+	} else {
+		for(i=0; i<len; i++) {
+			double rot = (ROTP[i])* PI/180,
+				s = sin(rot),
+				c = cos(rot);
+			CTRLI[i] = (DACI[i]*c + DACQ[i]*s)*gain;
+			CTRLQ[i] = (DACI[i]*s - DACQ[i]*c)*gain;
+		}
+	}
+
+	for(i=0; i<len; i++) {
+		CTRLA[i] = sqrt(CTRLI[i]*CTRLI[i] + CTRLQ[i]*CTRLQ[i]);
+	}
+
+	if(fast) {
+		for(i=0; i<len; i++) {
+			CTRLP[i] = atan2_fast(CTRLQ[i], CTRLI[i]) * (180.0 / PI);
+		}
+		for(i=0; i<len; i++) {
+			DACP[i] = atan2_fast(DACQ[i], DACI[i]) * (180.0 / PI);
+		}
+	} else {
+		for(i=0; i<len; i++) {
+			CTRLP[i] = atan2(CTRLQ[i], CTRLI[i]) * 180 / PI;
+		}
+		for(i=0; i<len; i++) {
+			DACP[i] = atan2(DACQ[i], DACI[i]) * 180 / PI;
+		}
+	}
+
+	if ( debug ) {
+		for(i=0; i<len; i++) {
 			printf("rot %f p %f selpoff %f i %f q %f p %f a %f gain %f\n",
-				rot, CAVP[i], poff, CTRLI[i], CTRLQ[i], CTRLP[i], CTRLA[i], gain);
+				ROTP[i]* PI/180, CAVP[i], poff, CTRLI[i], CTRLQ[i], CTRLP[i], CTRLA[i], gain);
 		}
 	}
 
@@ -845,17 +2113,37 @@ long ctrl_lims(aSubRecord* prec)
  * based on piezo_sf_consts.  The BCOEF complex number provided here is in units 
  * of 1/s, matches the value given to digaree in piezo_sf_consts 
  */
+/* Elements processed together.  Intermediates stay in L1 cache. */
+#define DF_BLOCK 256u
+
+/* One element by C99 complex division, which gives inf rather than NaN
+ * for a zero cavity phasor, and scales to avoid under/overflow.
+ * Used where the explicit division in calc_df() gives a non-finite result.
+ */
+static
+void calc_df_c99(double ci, double cq, double fi, double fq, double di, double dq,
+                 double complex bcoef, double *fc, double *df, double *bw)
+{
+	double complex denom_cmplx = 2 * PI * (ci + cq*_Complex_I),
+		fc_cmplx = (di + dq*_Complex_I) / denom_cmplx,
+		a_cmplx = fc_cmplx - ((bcoef * (fi + fq*_Complex_I)) / denom_cmplx);
+
+	*df = cimag( a_cmplx);
+	*bw = -creal( a_cmplx);
+	*fc = cimag( fc_cmplx);
+}
+
 static
 long calc_df(aSubRecord* prec)
 {
 	short debug = (prec->tpro > 1) ? 1 : 0;
 
-	size_t i;
+	size_t i, b;
 	epicsUInt32 len = prec->nea; /* actual output length */
 	double bcoefm = 0.0, bcoefp = 0.0,
 		cavscl = 1.0, fwdscl = 1.0, sampt = 1.0;
 
-	double complex dvdt_cmplx, bcoef_cmplx, fwd_cmplx, cav_cmplx, denom_cmplx, a_cmplx, fc_cmplx;
+	double bcoefr, bcoefi, dscl, icavscl, ifwdscl;
 
 	double *CAVI = (double*)prec->a,
 		*CAVQ  = (double*)prec->b,
@@ -897,6 +2185,11 @@ long calc_df(aSubRecord* prec)
 		sampt = *(double*)prec->i;
 	}
 
+	/* hoisted from loops */
+	dscl = 0.5/sampt/cavscl;
+	icavscl = 1.0/cavscl;
+	ifwdscl = 1.0/fwdscl;
+
 	epicsTimeStamp cavi, cavq, fwdi, fwdq;
 	double t1, t2, t3;
     dbGetTimeStamp(&prec->inpa, &cavi);
@@ -932,46 +2225,85 @@ long calc_df(aSubRecord* prec)
 	if(len > prec->nove)
 		len = prec->nove;
 
-	/* investigate writing this as bcoefm * exp(bcoefp*PI/180*_Complex_I) */
-	bcoef_cmplx = bcoefm * cos(bcoefp*PI/180.0)  + (bcoefm * sin(bcoefp*PI/180.0))*_Complex_I;
+	/* central difference needs 3 points */
+	if(len < 3) {
+		prec->neva = prec->nevb = prec->nevc = prec->nevd = prec->neve = 0;
+		(void)recGblSetSevr(prec, CALC_ALARM, INVALID_ALARM);
+		return 0;
+	}
+
+	bcoefr = bcoefm * cos(bcoefp*PI/180.0);
+	bcoefi = bcoefm * sin(bcoefp*PI/180.0);
 	if ( debug ) {
 		printf("\nbcoefm %f bcoefp %f bcoef_cmplx %f +i %f sampt %f cavscl %fwdscl %f\n", 
-				bcoefm, bcoefp, creal(bcoef_cmplx), cimag(bcoef_cmplx), sampt, cavscl, fwdscl);
+				bcoefm, bcoefp, bcoefr, bcoefi, sampt, cavscl, fwdscl);
 	}
 
-	for (i=0; i<len; i++) {
-		if ( i == 0 ) {
-			DVDTI[i] = 0.5*(CAVI[i+2] - CAVI[i])/sampt/cavscl;
-			DVDTQ[i] = 0.5*(CAVQ[i+2] - CAVQ[i])/sampt/cavscl;
-		}
-		else if ( i < len - 1 ) {
-			DVDTI[i] = 0.5*(CAVI[i+1] - CAVI[i-1])/sampt/cavscl;
-			DVDTQ[i] = 0.5*(CAVQ[i+1] - CAVQ[i-1])/sampt/cavscl;
+	/* dV/dt by central difference.  First uses the next interval, last repeats */
+	DVDTI[0] = (CAVI[2] - CAVI[0])*dscl;
+	DVDTQ[0] = (CAVQ[2] - CAVQ[0])*dscl;
+	for (i=1; i<len-1; i++) {
+		DVDTI[i] = (CAVI[i+1] - CAVI[i-1])*dscl;
+		DVDTQ[i] = (CAVQ[i+1] - CAVQ[i-1])*dscl;
+	}
+	DVDTI[len-1] = DVDTI[len-2];
+	DVDTQ[len-1] = DVDTQ[len-2];
+
+	/* Complex division written out so that real and imaginary parts
+	 * are computed in parallel.  With cav = CAV/cavscl and fwd = FWD/fwdscl
+	 *
+	 *   fc = dvdt / (2 PI cav)
+	 *   a  = (dvdt - bcoef * fwd) / (2 PI cav)
+	 *
+	 * Results go through local buffers, which can not alias the inputs,
+	 * so that the compiler may vectorize without runtime overlap checks.
+	 */
+	for (b=0; b<len; b+=DF_BLOCK) {
+		size_t n = MIN(DF_BLOCK, len-b);
+		double fcb[DF_BLOCK], dfb[DF_BLOCK], bwb[DF_BLOCK];
+		const double *cavi = CAVI+b, *cavq = CAVQ+b,
+			*fwdi = FWDI+b, *fwdq = FWDQ+b,
+			*dvdti = DVDTI+b, *dvdtq = DVDTQ+b;
+		double nonfinite = 0.0;
+
+		for (i=0; i<n; i++) {
+			double ci = cavi[i]*icavscl, cq = cavq[i]*icavscl,
+				fi = fwdi[i]*ifwdscl, fq = fwdq[i]*ifwdscl,
+				di = dvdti[i], dq = dvdtq[i],
+				/* 1/(2 PI |cav|^2) */
+				r = 1.0/(2.0*PI*(ci*ci + cq*cq)),
+				ni = di - (bcoefr*fi - bcoefi*fq),
+				nq = dq - (bcoefr*fq + bcoefi*fi);
+
+			/* From Larry Doolittle, 2021-05-06
+			 * fc_cmplx = dvdt_cmplx / (2 * PI * cav_cmplx) is independent of bcoef! 
+			 * It's just the instantaneous operating frequency.  When running in SELA, 
+			 * with no reactive power (requires a correctly set SEL phase offset),
+			 * its imaginary part should give a pretty accurate detuning waveform by itself.
+			 * Of course it's useless (zero plus noise) in SELAP.  But if the BCOEF value is
+			 * suspect, or too opaque for people commissioning the cavity in SELA mode,
+			 * being able to see this easily-documented waveform could build confidence.
+			 */
+			fcb[i] = (dq*ci - di*cq)*r;
+			/* give output in Hz, not radians/sec */
+			dfb[i] = (nq*ci - ni*cq)*r;
+			bwb[i] = -(ni*ci + nq*cq)*r;
+			/* A sum is non-finite if any term is, or (harmlessly) on overflow */
+			nonfinite = fabs(fcb[i] + dfb[i] + bwb[i]) <= DBL_MAX ? nonfinite : 1.0;
 		}
-		else {
-			DVDTI[i] = DVDTI[i-1];
-			DVDTQ[i] = DVDTQ[i-1];
+
+		/* rare.  eg. zero cavity phasor, or NaN input */
+		for (i=0; nonfinite!=0.0 && i<n; i++) {
+			if (!isfinite(fcb[i]) || !isfinite(dfb[i]) || !isfinite(bwb[i])) {
+				calc_df_c99(cavi[i]*icavscl, cavq[i]*icavscl,
+					fwdi[i]*ifwdscl, fwdq[i]*ifwdscl, dvdti[i], dvdtq[i],
+					bcoefr + bcoefi*_Complex_I, &fcb[i], &dfb[i], &bwb[i]);
+			}
 		}
-		dvdt_cmplx = DVDTI[i] + DVDTQ[i]*_Complex_I;
-		fwd_cmplx = FWDI[i]/fwdscl + (FWDQ[i]/fwdscl)*_Complex_I;
-		cav_cmplx = CAVI[i]/cavscl + (CAVQ[i]/cavscl)*_Complex_I;
-
-		/* From Larry Doolittle, 2021-05-06
-		 * fc_cmplx = dvdt_cmplx / (2 * PI * cav_cmplx) is independent of bcoef! 
-		 * It's just the instantaneous operating frequency.  When running in SELA, 
-		 * with no reactive power (requires a correctly set SEL phase offset),
-		 * its imaginary part should give a pretty accurate detuning waveform by itself.
-		 * Of course it's useless (zero plus noise) in SELAP.  But if the BCOEF value is
-		 * suspect, or too opaque for people commissioning the cavity in SELA mode,
-		 * being able to see this easily-documented waveform could build confidence.
-		 */
-		denom_cmplx = 2 * PI * cav_cmplx;
-		fc_cmplx = dvdt_cmplx / denom_cmplx;
-		a_cmplx= fc_cmplx - ((bcoef_cmplx * fwd_cmplx) / denom_cmplx);  /* give output in Hz, not radians/sec */
-
-		DF[i] = cimag( a_cmplx);
-		BW[i] = -creal( a_cmplx);
-		FC[i] = cimag( fc_cmplx);
+
+		memcpy(FC+b, fcb, n*sizeof(*fcb));
+		memcpy(DF+b, dfb, n*sizeof(*dfb));
+		memcpy(BW+b, bwb, n*sizeof(*bwb));
 	}
 
 	/* Hack to improve end data points
@@ -1082,6 +2414,9 @@ static registryFunctionRef asub_seq[] = {
     {"WG Gen", (REGISTRYFUNCTION) &gen_waveform},
     {"WG Init", (REGISTRYFUNCTION) &init_waveform},
     {"Wf Stats", (REGISTRYFUNCTION) &wf_stats},
+    {"IQ2AP Stats", (REGISTRYFUNCTION) &iq2ap_stats},
+    {"Wf Stats Multi Init", (REGISTRYFUNCTION) &init_wf_stats_multi},
+    {"Wf Stats Multi", (REGISTRYFUNCTION) &wf_stats_multi},
     {"Phase Unwrap", (REGISTRYFUNCTION) &unwrap},
     {"Controller Output", (REGISTRYFUNCTION) &calc_ctrl},
     {"Controller Limits", (REGISTRYFUNCTION) &ctrl_lims},
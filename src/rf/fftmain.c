@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -7,6 +8,7 @@
 #include <sys/time.h>
 
 #include <epicsThread.h>
+#include <epicsString.h>
 #include <registry.h>
 #include <errlog.h>
 #include <dbDefs.h>
@@ -22,20 +24,37 @@ epicsMutexId  fftPlanMutex;     /* Global mutex for use of FFTW plan creation,
  							     * which is not thread safe
 							     */
 
+/* FFTW wisdom file, from environment variable FEED_FFT_WISDOM.
+ * Loaded at IOC start, and saved whenever a plan had to be measured,
+ * so that plans for lengths seen before are created without measuring.
+ */
+static char *fftWisdomFile;
+
 /* Two types of FFTs:
  *  - complex-to-complex
  *  - real-to-complex
  * Assumptions/requirements
  *  - Maximum input data lengths are the same
  */
-typedef struct FFTPlanRec_ {
-	fftw_plan plan;    /* Plan used for FFT transform */
+
+/* Arrays shared by all plans of one FFT task, allocated for the maximum
+ * input data length.  fftw_malloc() gives the alignment FFTW needs for SIMD.
+ */
+typedef struct FFTBufRec_ {
 /* input array used for complex-to-complex */
 	fftw_complex *in;  /* Input array  (time domain) */
 /* input arrays used for real-to-complex */
 	double *in_re;  /* Real input array */
 /* output array */
 	fftw_complex *out; /* Output array (frequency domain) */	
+} FFTBufRec, *FFTBuf;
+
+/* Plan cache entry, for one conversion type and input data length */
+typedef struct FFTPlanRec_ {
+	fftw_plan plan;    /* Plan used for FFT transform, NULL if entry unused */
+	int type;          /* FFT type, see FFT_TYPE_* */
+	size_t len;        /* Input data length */
+	unsigned long used; /* Time of last use, counted in messages */
 } FFTPlanRec, *FFTPlan;
 
 /* just any unique address */
@@ -87,92 +106,139 @@ char name[MAX_NAME_LENGTH];
 	return (FFTData)registryFind(registryId, name);
 }
 
+/* Call with fftPlanMutex held.
+ * Written to a temporary file, then renamed, so that the wisdom file
+ * is never left partially written.
+ */
 static void
-rf_fft_destroy_plan(FFTPlan fftplan, int type)
+rf_fft_save_wisdom(void)
 {
-	epicsMutexLock( fftPlanMutex );
+FILE *fp;
+char *tmp;
 
-	fftw_destroy_plan( fftplan->plan );
+	if ( ! fftWisdomFile ) {
+		return;
+	}
 
-	switch (type) {
+	if ( ! (tmp = malloc(strlen(fftWisdomFile) + 5)) ) {
+		errlogPrintf("rf_fft_save_wisdom: No memory\n");
+		return;
+	}
+	sprintf( tmp, "%s.tmp", fftWisdomFile );
 
-		case FFT_TYPE_C2C:
-			fftw_free( fftplan->in );
-			fftw_free( fftplan->out );
-			break;
-		case FFT_TYPE_R2C:
-			fftw_free( fftplan->in_re );
-			fftw_free( fftplan->out );
-			break;
+	if ( ! (fp = fopen( tmp, "w" )) ) {
+		errlogPrintf("rf_fft_save_wisdom: Failed to open %s\n", tmp);
+		free( tmp );
+		return;
 	}
 
-	epicsMutexUnlock( fftPlanMutex );
-}
+	fftw_export_wisdom_to_file( fp );
 
-static int
-rf_fft_update_plan_c2c(FFTPlan fftplan, size_t len)
-{
-	if ( ! (fftplan->in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * len) ) ) {
-		errlogPrintf("rf_fft_update_plan_c: No memory for FFT input data\n");
-		return -1;
+	if ( fclose( fp ) || rename( tmp, fftWisdomFile ) ) {
+		errlogPrintf("rf_fft_save_wisdom: Failed to write %s\n", fftWisdomFile);
+		remove( tmp );
 	}
 
-	if ( ! (fftplan->out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * len) ) ) {
-		errlogPrintf("rf_fft_update_plan_c: No memory for FFT output data\n");
-		return -1;
-	}
+	free( tmp );
+}
 
+static void
+rf_fft_destroy_plan(FFTPlan fftplan)
+{
 	epicsMutexLock( fftPlanMutex );
 
-	fftplan->plan = fftw_plan_dft_1d(len, fftplan->in, fftplan->out, FFTW_FORWARD, FFTW_MEASURE);
+	fftw_destroy_plan( fftplan->plan );
+	fftplan->plan = 0;
 
 	epicsMutexUnlock( fftPlanMutex );
+}
 
-	return 0;
+static void
+rf_fft_free_buf(FFTBuf buf)
+{
+	fftw_free( buf->in );
+	fftw_free( buf->in_re );
+	fftw_free( buf->out );
+	buf->in = 0;
+	buf->in_re = 0;
+	buf->out = 0;
 }
 
 static int
-rf_fft_update_plan_r2c(FFTPlan fftplan, size_t len)
+rf_fft_create_buf(FFTBuf buf, size_t len)
 {
-	if ( ! (fftplan->in_re = (double*) fftw_malloc(sizeof(double) * len) ) ) {
-		errlogPrintf("rf_fft_update_plan_r: No memory for FFT input data\n");
+	memset( buf, 0, sizeof(*buf) );
+
+	if ( ! (buf->in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * len) ) ) {
+		errlogPrintf("rf_fft_create_buf: No memory for FFT input data\n");
+		return -1;
+	}
+
+	if ( ! (buf->in_re = (double*) fftw_malloc(sizeof(double) * len) ) ) {
+		errlogPrintf("rf_fft_create_buf: No memory for FFT real input data\n");
+		rf_fft_free_buf( buf );
 		return -1;
 	}
 
-	if ( ! (fftplan->out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * len) ) ) {
-		errlogPrintf("rf_fft_update_plan_r: No memory for FFT output data\n");
+	if ( ! (buf->out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * len) ) ) {
+		errlogPrintf("rf_fft_create_buf: No memory for FFT output data\n");
+		rf_fft_free_buf( buf );
 		return -1;
 	}
 
+	return 0;
+}
+
+static void
+rf_fft_update_plan_c2c(FFTPlan fftplan, FFTBuf buf, size_t len)
+{
 	epicsMutexLock( fftPlanMutex );
 
-	fftplan->plan = fftw_plan_dft_r2c_1d(len, fftplan->in_re, fftplan->out, FFTW_MEASURE);
+	/* Fast when wisdom already has this length.  Otherwise measure, and save */
+	fftplan->plan = fftw_plan_dft_1d(len, buf->in, buf->out, FFTW_FORWARD, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+	if ( ! fftplan->plan ) {
+		fftplan->plan = fftw_plan_dft_1d(len, buf->in, buf->out, FFTW_FORWARD, FFTW_MEASURE);
+		if ( fftplan->plan ) {
+			rf_fft_save_wisdom();
+		}
+	}
 
 	epicsMutexUnlock( fftPlanMutex );
+}
 
-	return 0;
+static void
+rf_fft_update_plan_r2c(FFTPlan fftplan, FFTBuf buf, size_t len)
+{
+	epicsMutexLock( fftPlanMutex );
+
+	/* Fast when wisdom already has this length.  Otherwise measure, and save */
+	fftplan->plan = fftw_plan_dft_r2c_1d(len, buf->in_re, buf->out, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+	if ( ! fftplan->plan ) {
+		fftplan->plan = fftw_plan_dft_r2c_1d(len, buf->in_re, buf->out, FFTW_MEASURE);
+		if ( fftplan->plan ) {
+			rf_fft_save_wisdom();
+		}
+	}
+
+	epicsMutexUnlock( fftPlanMutex );
 }
 
 static int
-rf_fft_update_plan(FFTPlan fftplan, size_t len, int new, int type)
+rf_fft_update_plan(FFTPlan fftplan, FFTBuf buf, size_t len, int type)
 {
-	/* Only destroy if updating pre-existing plan */
-	if ( !new ) {
-		rf_fft_destroy_plan( fftplan, type );
+	/* Only destroy if replacing pre-existing plan */
+	if ( fftplan->plan ) {
+		rf_fft_destroy_plan( fftplan );
 	}
 
 	switch (type) {
 
 		case FFT_TYPE_C2C:
-			if ( rf_fft_update_plan_c2c( fftplan, len ) ) {
-				return -1;
-			}
+			rf_fft_update_plan_c2c( fftplan, buf, len );
 			break;
 
 		case FFT_TYPE_R2C:
-			if ( rf_fft_update_plan_r2c( fftplan, len ) ) {
-				return -1;
-			}
+			rf_fft_update_plan_r2c( fftplan, buf, len );
 			break;
 	}
 
@@ -180,24 +246,44 @@ rf_fft_update_plan(FFTPlan fftplan, size_t len, int new, int type)
 		return -1;
 	}
 
+	fftplan->type = type;
+	fftplan->len  = len;
+
 	return 0;
 }
 
+/* Find the cached plan for this type and length.  If not cached, create it,
+ * in an unused entry, or replacing the least recently used.
+ * Sets *created when a plan was created.  Returns NULL on failure.
+ */
 static FFTPlan
-rf_fft_create_plan(size_t len, int type)
+rf_fft_find_plan(FFTPlanRec *cache, FFTBuf buf, size_t len, int type, unsigned long now, int *created)
 {
-FFTPlan fftplan = 0;
+FFTPlan lru = &cache[0];
+int i;
 
-	if ( ! (fftplan = malloc( sizeof(FFTPlanRec))) ) {
-		errlogPrintf("rf_fft_create_plan: No memory for FFT plan struct type %i", type);
-		return 0;
+	*created = 0;
+
+	for ( i = 0; i < FFT_PLAN_CACHE; i++ ) {
+		if ( cache[i].plan && cache[i].type == type && cache[i].len == len ) {
+			cache[i].used = now;
+			return &cache[i];
+		}
+		/* unused entries count as used at time 0 */
+		if ( (cache[i].plan ? cache[i].used : 0) < (lru->plan ? lru->used : 0) ) {
+			lru = &cache[i];
+		}
 	}
 
-	if ( rf_fft_update_plan( fftplan, len, 1, type ) ) {
+	*created = 1;
+
+	if ( rf_fft_update_plan( lru, buf, len, type ) ) {
 		return 0;
 	}
 
-	return fftplan;
+	lru->used = now;
+
+	return lru;
 }
 
 /*
@@ -213,7 +299,7 @@ FFTPlan fftplan = 0;
  */
 
 static void
-rf_fft_execute_plan_c2c(FFTPlan fftplan, size_t len, double tstep, int debug, double *in_re, double *in_im, double *out_re, double *out_im, double *out_freq, size_t *len_output, double *fstep)
+rf_fft_execute_plan_c2c(FFTPlan fftplan, FFTBuf buf, size_t len, double tstep, int debug, double *in_re, double *in_im, double *out_re, double *out_im, double *out_freq, size_t *len_output, double *fstep)
 {
 int n, offset;
 
@@ -223,7 +309,7 @@ int n, offset;
 
 	/* Initialize input after creating plan (creating plan overwrites the arrays when using FFTW_MEASURE) */
 	for ( n = 0; n < len; n++ ) {
-		fftplan->in[n] = in_re[n] + I*in_im[n];
+		buf->in[n] = in_re[n] + I*in_im[n];
 	}
 
 	/* execute is thread-safe so does not need to be guarded by global mutex fftplanMutex */
@@ -244,15 +330,15 @@ int n, offset;
 		else {
 			offset = -len/2;
 		}
-		out_re[n + offset] = creal(fftplan->out[n])/len;
-		out_im[n + offset] = cimag(fftplan->out[n])/len;
+		out_re[n + offset] = creal(buf->out[n])/len;
+		out_im[n + offset] = cimag(buf->out[n])/len;
 
 		out_freq[n]  = (double)(n - len/2.0) * *fstep;
 
 		/* temporary */
 		if ( debug ) {
 			errlogPrintf("unnormalized: plan index %i %.10f + i*%.10f adjusted index %i %.10f + i*%.10f\n", 
-				n, creal(fftplan->out[n]), cimag(fftplan->out[n]), n + offset, out_re[n + offset], out_im[n + offset]);
+				n, creal(buf->out[n]), cimag(buf->out[n]), n + offset, out_re[n + offset], out_im[n + offset]);
 		}
 	}
 }
@@ -270,7 +356,7 @@ int n, offset;
  */
 
 static void
-rf_fft_execute_plan_r2c(FFTPlan fftplan, size_t len, double tstep, int debug, double *in_re, double *out_re, double *out_im, double *out_freq, size_t *len_output, double *fstep)
+rf_fft_execute_plan_r2c(FFTPlan fftplan, FFTBuf buf, size_t len, double tstep, int debug, double *in_re, double *out_re, double *out_im, double *out_freq, size_t *len_output, double *fstep)
 {
 int n;
 
@@ -285,7 +371,7 @@ int n;
 
 	/* Initialize input after creating plan (creating plan overwrites the arrays when using FFTW_MEASURE) */
 	for ( n = 0; n < len; n++ ) {
-		fftplan->in_re[n] = in_re[n];
+		buf->in_re[n] = in_re[n];
 	}
 
 	/* execute is thread-safe so does not need to be guarded by global mutex fftplanMutex */
@@ -301,15 +387,15 @@ int n;
 	for ( n = 0; n < *len_output; n++ ) {
 
 		/* check normalization */
-		out_re[n] = creal(fftplan->out[n])/len;
-		out_im[n] = cimag(fftplan->out[n])/len;
+		out_re[n] = creal(buf->out[n])/len;
+		out_im[n] = cimag(buf->out[n])/len;
 
 		out_freq[n]  = (double)n * *fstep;
 
 		/* temporary */
 		if ( debug ) {
 			errlogPrintf("unnormalized: plan index %i %.10f output %.10f +i %.10f freq %.1f\n", 
-				n, fftplan->in_re[n], out_re[n], out_im[n], out_freq[n]);
+				n, buf->in_re[n], out_re[n], out_im[n], out_freq[n]);
 		}
 	}
 }
@@ -343,24 +429,32 @@ FFTMsg msg = 0;
  *     When receive message, execute FFT plan of specified type,
  *        send reply message containing frequency domain data, length of 
  *        that data, array of frequency steps, frequency time step
- *     If received message of conversion type N input data length does not 
- *        match the current plan, update the plan. This should happen rarely.
+ *     Plans are cached by conversion type and input data length.
+ *        If a received message needs a plan not in the cache, create it,
+ *        replacing the least recently used. Switching between a few
+ *        lengths then costs nothing after the first time each is seen.
  *
  */
 static int
 fft_task(FFTData fftData)
 {
-	FFTPlan fftplans[FFT_MAX_PLAN] = { 0, 0 };
+	FFTPlanRec fftplans[FFT_PLAN_CACHE];
+
+	FFTPlan fftplan;
+
+	FFTBufRec buf;
 
 	FFTMsg  msg = 0;
 
-	int index, type, i;
+	int index, type, i, created;
+
+	unsigned long now = 0; /* Message count, for least recently used plan replacement */
 
 	double *in_re, *in_im, *out_re, *out_im, *out_freq; /* Local pointers */
 
 	double fstep = 0;
 
-	size_t len_current[FFT_MAX_PLAN], len_max, len_output = 0;
+	size_t len_max, len_output = 0;
 
 	epicsMessageQueueId queue_id = fftData->queue_id;
 
@@ -375,10 +469,16 @@ fft_task(FFTData fftData)
 	/* errlogPrintf("fft_task: %s Create first plan length %i\n", fftData->thread_name, (int)len_max);
 	gettimeofday( &time_start, NULL ); */
 
-	/* Creating/updating a plan is slow; this should happen rarely */
+	memset( fftplans, 0, sizeof(fftplans) );
+
+	if ( rf_fft_create_buf( &buf, len_max ) ) {
+		errlogPrintf("fft_task: %s Failed to create FFT arrays. Exit.\n", fftData->thread_name);
+		return 0;
+	}
+
+	/* Creating a plan is slow, unless found in wisdom; this should happen rarely */
 	for ( i = 0; i < FFT_MAX_PLAN; i++ ) {
-		len_current[i] = len_max;
-		if ( ! (fftplans[i] = rf_fft_create_plan( len_current[i], i )) ) {
+		if ( ! rf_fft_find_plan( fftplans, &buf, len_max, i, ++now, &created ) ) {
 			errlogPrintf("fft_task: %s Failed to create FFT plan %i", fftData->thread_name, i);
 			return 0;
 		}	
@@ -404,29 +504,27 @@ fft_task(FFTData fftData)
 			continue;
 		}
 
-		if ( msg->len != len_current[type] ) {
-			if ( msg->debug ) {
-				errlogPrintf("fft_task: %s msg->len %i != len_current %i, destroy/recreate plan\n", 
-					fftData->thread_name, (int)msg->len, (int)len_current[type]);
-				gettimeofday( &time_start, NULL );
-			}
+		if ( (type < 0) || (type >= FFT_MAX_PLAN) || (msg->len < 1) || (msg->len > len_max) ) {
+			errlogPrintf("fft_task: %s Illegal type %i or data length %i\n", fftData->thread_name, type, (int)msg->len);
+			continue;
+		}
 
-			if ( rf_fft_update_plan( fftplans[type], msg->len, 0, type ) ) {
-				errlogPrintf("fft_task: %s Failed to update FFT plan type %i\n", fftData->thread_name, type);
-				return 0;
-			}
-			else if ( msg->debug ) {
-				errlogPrintf("rfFFTTask: %s Created new plan of %i elements\n", fftData->thread_name, (int)msg->len);
-			}
+		if ( msg->debug ) {
+			gettimeofday( &time_start, NULL );
+		}
 
-			if ( msg->debug ) {
-				gettimeofday( &time_now, NULL );
-				errlogPrintf("fft_task: %s Update plan elapsed %i s %i usec\n",  fftData->thread_name,
-					(int)(time_now.tv_sec - time_start.tv_sec), (int)(time_now.tv_usec - time_start.tv_usec));
-			}
+		if ( ! (fftplan = rf_fft_find_plan( fftplans, &buf, msg->len, type, ++now, &created )) ) {
+			errlogPrintf("fft_task: %s Failed to create FFT plan type %i length %i\n",
+				fftData->thread_name, type, (int)msg->len);
+			continue;
 		}
 
-		len_current[type] = msg->len;
+		if ( msg->debug && created ) {
+			gettimeofday( &time_now, NULL );
+			errlogPrintf("fft_task: %s Created new plan type %i of %i elements, elapsed %i s %i usec\n",
+				fftData->thread_name, type, (int)msg->len,
+				(int)(time_now.tv_sec - time_start.tv_sec), (int)(time_now.tv_usec - time_start.tv_usec));
+		}
 
 		in_re = msg->in_re;
 		in_im = msg->in_im;
@@ -443,16 +541,16 @@ fft_task(FFTData fftData)
 		switch (type) {
 
 			case FFT_TYPE_C2C:
-				rf_fft_execute_plan_c2c( fftplans[FFT_TYPE_C2C], len_current[type], msg->tstep, msg->debug, in_re, in_im, out_re, out_im, out_freq, &len_output, &fstep);
+				rf_fft_execute_plan_c2c( fftplan, &buf, msg->len, msg->tstep, msg->debug, in_re, in_im, out_re, out_im, out_freq, &len_output, &fstep);
 				break;
 
 			case FFT_TYPE_R2C:
-				rf_fft_execute_plan_r2c( fftplans[FFT_TYPE_R2C], len_current[type], msg->tstep, msg->debug, in_re, out_re, out_im, out_freq, &len_output, &fstep);
+				rf_fft_execute_plan_r2c( fftplan, &buf, msg->len, msg->tstep, msg->debug, in_re, out_re, out_im, out_freq, &len_output, &fstep);
 				break;
 		}
 
 
-		fftData->len[index]   = len_current[type]; /* input data length  */
+		fftData->len[index]   = msg->len;          /* input data length  */
 		fftData->len_output[index] = len_output;   /* output data length */
 		fftData->fstep[index] = fstep;
 		fftData->tstep[index] = msg->tstep;
@@ -527,8 +625,22 @@ char    thread_name[MAX_NAME_LENGTH];
 static void
 fftMainInit(void)
 {
+const char *wisdom = getenv("FEED_FFT_WISDOM");
+
 	fftPlanMutex     = epicsMutexCreate();
 	fftInitTaskMutex = epicsMutexCreate();
+
+	if ( wisdom && wisdom[0] ) {
+		fftWisdomFile = epicsStrDup( wisdom );
+
+		/* Missing on first start.  Created when the first plan is measured */
+		if ( fftw_import_wisdom_from_filename( fftWisdomFile ) ) {
+			errlogPrintf("# Loaded FFTW wisdom from %s\n", fftWisdomFile);
+		}
+		else {
+			errlogPrintf("# No FFTW wisdom loaded from %s\n", fftWisdomFile);
+		}
+	}
 }
 
 void 
@@ -9,7 +9,8 @@
 #define FFT_MAX_SIG 10 /* Maximum waveform signals per channel (per cavity) 
 						* these will be processed by single thread
 						*/
-#define FFT_MAX_PLAN 2
+#define FFT_MAX_PLAN 2   /* Number of FFT conversion types */
+#define FFT_PLAN_CACHE 8 /* Plans kept per FFT thread, by type and length */
 
 /* Supported FFT conversion types */
 #define FFT_TYPE_C2C 0 /* Complex to complex, fftwf_plan_dft_1d */
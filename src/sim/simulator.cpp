@@ -4,8 +4,15 @@
 #include <map>
 
 #include <poll.h>
+#ifdef __linux__
+#  include <sys/socket.h>
+#endif
+
+#include <math.h>
 
 #include <errlog.h>
+#include <epicsStdlib.h>
+#include <epicsTime.h>
 
 #include "simulator.h"
 #include "device.h"
@@ -29,9 +36,113 @@ SimReg::SimReg(const JRegister& reg)
         throw std::runtime_error(SB()<<name<<" has inconsistent base "<<base<<" and addr_width "<<reg.addr_width);
 }
 
+void SimImpair::clear()
+{
+    drop = duplicate = reorder = truncate = 0.0;
+    delay = None;
+    delay_min = delay_max = 0.0;
+    pareto_alpha = 1.0;
+    rate = 0.0;
+    seed = 0u;
+}
+
+bool SimImpair::active() const
+{
+    return drop>0.0 || duplicate>0.0 || reorder>0.0 || truncate>0.0 || delay!=None || rate>0.0;
+}
+
+namespace {
+double parse_num(const std::string& key, const std::string& val)
+{
+    double ret;
+    if(epicsParseDouble(val.c_str(), &ret, 0) || ret<0.0)
+        throw std::runtime_error(SB()<<"Impairment "<<key<<"= expects a non-negative number, not '"<<val<<"'");
+    return ret;
+}
+double parse_prob(const std::string& key, const std::string& val)
+{
+    double ret = parse_num(key, val);
+    if(ret>1.0)
+        throw std::runtime_error(SB()<<"Impairment "<<key<<"= probability must be in [0, 1]");
+    return ret;
+}
+} // namespace
+
+void SimImpair::parse(const std::string& spec)
+{
+    SimImpair temp(*this);
+
+    size_t start = 0u;
+    while(start<spec.size()) {
+        size_t end = spec.find(',', start);
+        if(end==spec.npos)
+            end = spec.size();
+        std::string item(spec.substr(start, end-start));
+        start = end+1u;
+
+        if(item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        if(eq==item.npos)
+            throw std::runtime_error(SB()<<"Impairment expected key=value, not '"<<item<<"'");
+        std::string key(item.substr(0, eq)), val(item.substr(eq+1));
+
+        if(key=="drop") {
+            temp.drop = parse_prob(key, val);
+        } else if(key=="dup") {
+            temp.duplicate = parse_prob(key, val);
+        } else if(key=="reorder") {
+            temp.reorder = parse_prob(key, val);
+        } else if(key=="trunc") {
+            temp.truncate = parse_prob(key, val);
+        } else if(key=="rate") {
+            temp.rate = parse_num(key, val);
+        } else if(key=="seed") {
+            temp.seed = epicsUInt32(parse_num(key, val));
+        } else if(key=="delay") {
+            std::vector<std::string> parts;
+            for(size_t p=0u; p<=val.size(); ) {
+                size_t colon = val.find(':', p);
+                if(colon==val.npos)
+                    colon = val.size();
+                parts.push_back(val.substr(p, colon-p));
+                p = colon+1u;
+            }
+
+            if(parts[0]=="none" && parts.size()==1u) {
+                temp.delay = None;
+            } else if(parts[0]=="uniform" && parts.size()==3u) {
+                temp.delay = Uniform;
+                temp.delay_min = parse_num(key, parts[1]);
+                temp.delay_max = parse_num(key, parts[2]);
+                if(temp.delay_max<temp.delay_min)
+                    throw std::runtime_error("Impairment delay=uniform:<min>:<max> with max < min");
+            } else if(parts[0]=="pareto" && (parts.size()==3u || parts.size()==4u)) {
+                temp.delay = Pareto;
+                temp.delay_min = parse_num(key, parts[1]);
+                temp.pareto_alpha = parse_num(key, parts[2]);
+                temp.delay_max = parts.size()==4u ? parse_num(key, parts[3]) : 0.0;
+                if(temp.pareto_alpha<=0.0)
+                    throw std::runtime_error("Impairment delay=pareto:<scale>:<alpha> alpha must be positive");
+            } else if(parts.size()==1u) {
+                temp.delay = Fixed;
+                temp.delay_min = parse_num(key, parts[0]);
+            } else {
+                throw std::runtime_error(SB()<<"Impairment invalid delay='"<<val<<"'");
+            }
+        } else {
+            throw std::runtime_error(SB()<<"Unknown impairment '"<<key<<"'");
+        }
+    }
+
+    *this = temp;
+}
+
 Simulator::Simulator(const osiSockAddr& ep, const JBlob& blob, const values_t &initial)
     :debug(false)
     ,slowdown(0.0)
+    ,nworkers(1u)
     ,running(false)
     ,serveaddr(ep)
 {
@@ -68,17 +179,17 @@ Simulator::Simulator(const osiSockAddr& ep, const JBlob& blob, const values_t &i
 
     for(values_t::const_iterator it=initial.begin(), end=initial.end(); it!=end; ++it)
     {
-        reg_by_addr_t::iterator rit = reg_by_addr.find(it->first);
-        if(rit==reg_by_addr.end()) {
+        const reg_by_addr_t::Range *rit = reg_by_addr.find(it->first);
+        if(!rit) {
             std::cout<<"Can't initialize non-existant register "<<std::hex<<it->first<<"\n";
             continue;
         }
-        SimReg& reg = *rit->second;
+        SimReg& reg = *rit->value;
         if(&reg==&romreg)
             continue; // don't override rom
         assert(reg.base!=0x800);
 
-        epicsUInt32 offset = rit->first - reg.base;
+        epicsUInt32 offset = it->first - reg.base;
 
         reg.storage[offset] = it->second;
     }
@@ -90,6 +201,7 @@ Simulator::Simulator(const osiSockAddr& ep, const JBlob& blob, const values_t &i
     }
 
     Socket::pipe(wakeupRx, wakeupTx);
+    Socket::pipe(stopRx, stopTx);
 }
 
 Simulator::~Simulator()
@@ -109,14 +221,14 @@ void Simulator::add(const SimReg& reg)
     if(!P.second)
         throw std::runtime_error(SB()<<"Duplicate register name: "<<reg.name);
 
-    for(epicsUInt32 addr = reg.base, endaddr = reg.base+reg.storage.size(); addr<endaddr; addr++)
-    {
-        reg_by_addr_t::const_iterator it(reg_by_addr.find(addr));
-        if(it!=reg_by_addr.end()) {
-            errlogPrintf("Overlapping registers at address %u: %s and %s\n",
-                         (unsigned)addr, it->second->name.c_str(), reg.name.c_str());
-        }
-        reg_by_addr[addr] = &P.first->second;
+    // later registers take precedence where addresses overlap
+    std::vector<SimReg*> displaced;
+    reg_by_addr.insert(reg.base, reg.storage.size(), &P.first->second, &displaced);
+
+    for(size_t i=0; i<displaced.size(); i++) {
+        errlogPrintf("Overlapping registers at address %u: %s and %s\n",
+                     (unsigned)std::max(reg.base, displaced[i]->base),
+                     displaced[i]->name.c_str(), reg.name.c_str());
     }
 }
 
@@ -125,168 +237,659 @@ void Simulator::endpoint(osiSockAddr& ep)
     ep = serveaddr;
 }
 
-void Simulator::exec()
+namespace {
+// serve sockets are non-blocking (see exec() ), so a send may
+// find the socket buffer full.  Wait for space, then retry.
+void wait_writable(const Socket& sock)
 {
-    Guard G(lock);
-    if(running)
-        throw std::logic_error("Already running");
-
-    std::vector<char> buf;
-    buf.reserve(pkt_size_limit);
+    pollfd fd;
+    fd.fd = sock;
+    fd.events = POLLOUT;
+    fd.revents = 0;
+    while(::poll(&fd, 1, -1)<0 && SOCKERRNO==SOCK_EINTR) {}
+}
 
-    try {
-        running = true;
+void sendto_retry(const Socket& sock, const osiSockAddr& peer, const std::vector<char>& buf)
+{
+    while(true) {
+        try {
+            sock.sendto(peer, buf);
+            return;
+        }catch(SocketError& e){
+            if(e.code!=SOCK_EWOULDBLOCK && e.code!=SOCK_EINTR)
+                throw;
+        }
+        wait_writable(sock);
+    }
+}
 
-        pollfd fds[2];
-        fds[0].fd = serve;
-        fds[1].fd = wakeupRx;
+// Datagrams received, and replied to, together.
+// Uses recvmmsg()/sendmmsg() where available.
+struct PacketBatch {
+    static const size_t limit = 16u;
 
-        bool stop = false;
+    std::vector<char> bufs[limit];
+    osiSockAddr peers[limit];
+    bool reply[limit];
+    size_t count;
 
-        while(!stop) {
+#ifdef __linux__
+    mmsghdr hdrs[limit];
+    iovec iovs[limit];
+#endif
 
-            bool process = false;
-            osiSockAddr peer;
+    PacketBatch() :count(0u)
+    {
+        for(size_t i=0; i<limit; i++)
+            bufs[i].resize(pkt_size_limit);
+    }
 
-            {
-                double sd = slowdown;
-                UnGuard U(G);
+    // non-blocking.  Returns number of datagrams received.
+    size_t recv(const Socket& sock)
+    {
+        count = 0u;
+#ifdef __linux__
+        for(size_t i=0; i<limit; i++) {
+            bufs[i].resize(pkt_size_limit);
+            iovs[i].iov_base = &bufs[i][0];
+            iovs[i].iov_len = bufs[i].size();
+            memset(&hdrs[i], 0, sizeof(hdrs[i]));
+            hdrs[i].msg_hdr.msg_name = &peers[i].sa;
+            hdrs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int ret = ::recvmmsg(sock, hdrs, limit, MSG_DONTWAIT, 0);
+        if(ret<0) {
+            int code = SOCKERRNO;
+            if(code==SOCK_EWOULDBLOCK || code==SOCK_EINTR)
+                return 0u;
+            throw SocketError(code);
+        }
+        count = ret;
+        for(size_t i=0; i<count; i++) {
+            bufs[i].resize(hdrs[i].msg_len);
+            reply[i] = true;
+        }
+#else
+        for(; count<limit; count++) {
+            bufs[count].resize(pkt_size_limit);
+            try {
+                sock.recvfrom(peers[count], bufs[count]);
+            }catch(SocketError& e){
+                if(e.code==SOCK_EWOULDBLOCK || e.code==SOCK_EINTR)
+                    break;
+                throw;
+            }
+            reply[count] = true;
+        }
+#endif
+        return count;
+    }
 
-                fds[0].events = POLLIN;
-                fds[1].events = POLLIN;
-                fds[0].revents = fds[1].revents = 0; // paranoia
+    void send(const Socket& sock)
+    {
+#ifdef __linux__
+        unsigned n=0;
+        for(size_t i=0; i<count; i++) {
+            if(!reply[i])
+                continue;
+            iovs[n].iov_base = &bufs[i][0];
+            iovs[n].iov_len = bufs[i].size();
+            memset(&hdrs[n], 0, sizeof(hdrs[n]));
+            hdrs[n].msg_hdr.msg_name = &peers[i].sa;
+            hdrs[n].msg_hdr.msg_namelen = sizeof(peers[i].ia);
+            hdrs[n].msg_hdr.msg_iov = &iovs[n];
+            hdrs[n].msg_hdr.msg_iovlen = 1;
+            n++;
+        }
+        for(unsigned sent=0; sent<n; ) {
+            int ret = ::sendmmsg(sock, hdrs+sent, n-sent, 0);
+            if(ret<0) {
+                int code = SOCKERRNO;
+                if(code==SOCK_EINTR)
+                    continue;
+                if(code==SOCK_EWOULDBLOCK) {
+                    wait_writable(sock);
+                    continue;
+                }
+                throw SocketError(code);
+            }
+            sent += ret;
+        }
+#else
+        for(size_t i=0; i<count; i++) {
+            if(reply[i])
+                sendto_retry(sock, peers[i], bufs[i]);
+        }
+#endif
+    }
+};
+
+// xorshift64*.  Quality is ample for fault injection
+struct SimRandom {
+    epicsUInt64 state;
+    explicit SimRandom(epicsUInt64 seed) :state(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+    epicsUInt64 next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    }
+    // [0, 1)
+    double uniform() { return (next()>>11) * (1.0/9007199254740992.0); }
+    bool chance(double p) { return p>0.0 && uniform() < p; }
+};
+
+// Applies SimImpair to the replies of one serving thread
+struct Impairer {
+    struct Delayed {
+        osiSockAddr peer;
+        std::vector<char> buf;
+        bool held; // reordered.  sent after the next reply
+    };
+    typedef std::multimap<double, Delayed> delayed_t;
+    delayed_t delayed;
+
+    SimRandom rng;
+    epicsTime start;
+    double tokens, last_refill;
+    size_t nheld;
+
+    Impairer(epicsUInt64 seed)
+        :rng(seed)
+        ,start(epicsTime::getCurrent())
+        ,tokens(0.0)
+        ,last_refill(0.0)
+        ,nheld(0u)
+    {}
+
+    double now() const { return epicsTime::getCurrent() - start; }
+
+    // poll() timeout in ms
+    int timeout() const
+    {
+        if(delayed.empty())
+            return -1;
+        double wait = delayed.begin()->first - now();
+        return wait<=0.0 ? 0 : int(wait*1000.0)+1;
+    }
 
-                int ret = ::poll(fds, 2, -1);
-                if(ret<0)
-                    throw SocketError(SOCKERRNO);
+    double sample_delay(const SimImpair& imp)
+    {
+        double ret = 0.0;
+        switch(imp.delay) {
+        case SimImpair::None:
+            break;
+        case SimImpair::Fixed:
+            ret = imp.delay_min;
+            break;
+        case SimImpair::Uniform:
+            ret = imp.delay_min + (imp.delay_max-imp.delay_min)*rng.uniform();
+            break;
+        case SimImpair::Pareto:
+            ret = imp.delay_min / pow(1.0-rng.uniform(), 1.0/imp.pareto_alpha);
+            if(imp.delay_max>0.0 && ret>imp.delay_max)
+                ret = imp.delay_max;
+            break;
+        }
+        return ret;
+    }
 
-                if(fds[1].revents&(POLLERR|POLLHUP)) {
-                    throw std::runtime_error("socket error from wakeupRx");
+    void send(const Socket& sock, const osiSockAddr& peer, const std::vector<char>& buf)
+    {
+        sendto_retry(sock, peer, buf);
+        if(nheld) {
+            // release reordered replies behind this one
+            for(delayed_t::iterator it(delayed.begin()), end(delayed.end()); it!=end; ) {
+                if(it->second.held) {
+                    sendto_retry(sock, it->second.peer, it->second.buf);
+                    delayed.erase(it++);
+                } else {
+                    ++it;
                 }
+            }
+            nheld = 0u;
+        }
+    }
 
-                if(fds[0].revents&POLLERR) {
-                    throw std::runtime_error("socket error from serve");
-                }
+    void apply(const SimImpair& imp, PacketBatch& batch, const Socket& sock, SimImpairStats& stats)
+    {
+        const double T = now();
+
+        if(imp.rate>0.0) {
+            // token bucket w/ 10ms burst
+            const double burst = std::max(1.0, imp.rate*0.01);
+            tokens = std::min(burst, tokens + (T-last_refill)*imp.rate);
+            last_refill = T;
+        }
+
+        for(size_t i=0; i<batch.count; i++) {
+            if(!batch.reply[i])
+                continue;
 
-                if(fds[1].revents&POLLIN) {
-                    fds[1].revents &= ~POLLIN;
+            std::vector<char>& buf = batch.bufs[i];
 
-                    char temp;
-                    wakeupRx.recvsome(&temp, 1);
-                    stop = true;
+            if(imp.rate>0.0) {
+                if(tokens<1.0) {
+                    stats.limited++;
+                    continue;
                 }
+                tokens -= 1.0;
+            }
 
+            if(rng.chance(imp.drop)) {
+                stats.dropped++;
+                continue;
+            }
 
-                if(fds[0].revents&POLLIN) {
-                    fds[0].revents &= ~POLLIN;
+            if(rng.chance(imp.truncate) && buf.size()>8u) {
+                // keep the header and a random number of whole commands
+                size_t ncmd = (buf.size()-8u)/8u;
+                buf.resize(8u + 8u*size_t(rng.uniform()*ncmd));
+                stats.truncated++;
+            }
 
-                    buf.resize(pkt_size_limit);
+            const unsigned ncopy = rng.chance(imp.duplicate) ? 2u : 1u;
+            if(ncopy>1u)
+                stats.duplicated++;
 
-                    serve.recvfrom(peer, buf);
-                    process = true;
-                }
+            const bool held = rng.chance(imp.reorder);
+            const double dly = sample_delay(imp);
 
-                if(fds[0].revents || fds[1].revents) {
-                    std::cerr<<"poll() events unhandled  "<<std::hex<<fds[0].revents<<" "<<std::hex<<fds[1].revents<<"\n";
+            for(unsigned n=0; n<ncopy; n++) {
+                if(!held && dly<=0.0) {
+                    send(sock, batch.peers[i], buf);
+                    continue;
                 }
-
-                if(!stop && sd > 0.0) {
-                    epicsThreadSleep(sd);
+                Delayed D;
+                D.peer = batch.peers[i];
+                D.buf = buf;
+                D.held = held;
+                // held replies go out after the next reply, or at most 10ms late
+                delayed.insert(std::make_pair(T + dly + (held ? 0.01 : 0.0), D));
+                if(held) {
+                    nheld++;
+                    stats.reordered++;
+                } else {
+                    stats.delayed++;
                 }
             }
-            // locked again
+        }
+    }
 
-            PrintAddr addr(peer);
+    // send replies which are due
+    void flush(const Socket& sock)
+    {
+        const double T = now();
+        while(!delayed.empty() && delayed.begin()->first <= T) {
+            delayed_t::iterator it(delayed.begin());
+            Delayed D;
+            D.peer = it->second.peer;
+            D.buf.swap(it->second.buf);
+            if(it->second.held)
+                nheld--;
+            delayed.erase(it);
+            send(sock, D.peer, D.buf);
+        }
+    }
+};
+
+struct SimWorker : public epicsThreadRunable {
+    const std::vector<Simulator*>& sims;
+    const Socket& stop;
+    const std::string name;
+    epicsThread thread;
+    SimWorker(const std::vector<Simulator*>& sims, const Socket& stop, unsigned idx)
+        :sims(sims)
+        ,stop(stop)
+        ,name(SB()<<"FEEDSIM"<<idx)
+        ,thread(*this, name.c_str(),
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                epicsThreadPriorityMedium)
+    {}
+    virtual ~SimWorker() {}
+    virtual void run() override final
+    {
+        try {
+            Simulator::serve_loop(sims, stop, false);
+        }catch(std::exception& e){
+            errlogPrintf("Simulator worker error: %s\n", e.what());
+        }
+    }
+};
 
-            if(process && buf.size()<32) {
-                errlogPrintf("%s: ignoring too short request (%u bytes)\n",
-                             addr.c_str(), unsigned(buf.size()));
-                process = false;
+// Run serve_loop() on the calling thread, and nthreads-1 others.
+// Returns when 'wake' is signaled.
+void serve_threads(const std::vector<Simulator*>& sims, unsigned nthreads,
+                   const Socket& wake, const Socket& stopTx, const Socket& stopRx)
+{
+    std::vector<SimWorker*> workers;
+
+    struct Joiner {
+        std::vector<SimWorker*>& workers;
+        const Socket& stopTx, & stopRx;
+        Joiner(std::vector<SimWorker*>& workers, const Socket& stopTx, const Socket& stopRx)
+            :workers(workers), stopTx(stopTx), stopRx(stopRx) {}
+        ~Joiner() {
+            if(workers.empty())
+                return;
+
+            char c = '!';
+            stopTx.sendall(&c, 1);
+
+            for(size_t i=0; i<workers.size(); i++) {
+                workers[i]->thread.exitWait();
+                delete workers[i];
             }
 
-            if(process) {
-                bool ignore = false;
+            stopRx.recvsome(&c, 1);
+        }
+    } joiner(workers, stopTx, stopRx);
 
-                if(buf.size()%8) {
-                    errlogPrintf("%s: sent request with %u bytes of trailing junk\n",
-                                 addr.c_str(), unsigned(buf.size()%8));
-                }
+    for(unsigned i=1; i<nthreads; i++) {
+        workers.push_back(new SimWorker(sims, stopRx, i));
+        workers.back()->thread.start();
+    }
+
+    Simulator::serve_loop(sims, wake, true);
+}
+} // namespace
+
+void Simulator::exec()
+{
+    unsigned nthreads;
+    {
+        Guard G(lock);
+        if(running)
+            throw std::logic_error("Already running");
+        running = true;
+        nthreads = std::max(1u, std::min(nworkers, 64u));
+    }
+
+    // workers may race to receive, so never block in recv
+    serve.set_blocking(false);
 
-                // build reply in place
-                // leave header alone and start with first command at offset 8
-
-                for(size_t i=8; i+8<=buf.size(); i+=8) {
-                    epicsUInt32 cmd_addr = ntohl(*reinterpret_cast<const epicsUInt32*>(&buf[i]));
-                    epicsUInt32 data = ntohl(*reinterpret_cast<const epicsUInt32*>(&buf[i+4]));
-
-                    reg_by_addr_t::iterator it(reg_by_addr.find(cmd_addr&0x00ffffff));
-
-                    if(cmd_addr&0xef000000) {
-                        errlogPrintf("%s: unused bits set in cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
-                    }
-
-                    if(it==reg_by_addr.end()) {
-                        errlogPrintf("%s: unknown cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
-
-                        if(cmd_addr&0x10000000) {
-                            data = 0xabadface;
-                        }
-
-                    } else {
-                        SimReg& reg = *it->second;
-                        size_t offset = (cmd_addr&0x00ffffff)-reg.base;
-
-                        if(reg.name=="ghost") {
-                            // magic register name to test timeout handling
-                            ignore = true;
-                        }
-
-                        if(cmd_addr&0x10000000) {
-                            // read
-                            data = reg.storage[offset];
-                            if(debug)
-                                errlogPrintf("%s: read %s[%u] (%06x) -> %08x\n",
-                                             addr.c_str(),
-                                             reg.name.c_str(), unsigned(offset),
-                                             unsigned(cmd_addr), unsigned(data));
-
-                            if(!reg.readable && debug) {
-                                errlogPrintf("%s: read of unreadable cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
-                            }
-
-                        } else {
-                            // write
-                            // echo back value written
-                            reg_write(reg, offset, data & reg.mask);
-                            if(debug)
-                                errlogPrintf("%s: write %s[%u] (%06x) <- %08x\n",
-                                             addr.c_str(),
-                                             reg.name.c_str(), unsigned(offset),
-                                             unsigned(cmd_addr), unsigned(reg.storage[offset]));
-
-                            if(!reg.writable) {
-                                errlogPrintf("%s: write of unwriteable cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
-
-                            }
-                        }
-                    }
-
-                    *reinterpret_cast<epicsUInt32*>(&buf[i+4]) = htonl(data);
+    try {
+        std::vector<Simulator*> sims(1, this);
+        serve_threads(sims, nthreads, wakeupRx, stopTx, stopRx);
+    }catch(...){
+        Guard G(lock);
+        running = false;
+        throw;
+    }
+
+    Guard G(lock);
+    running = false;
+}
+
+void Simulator::serve_loop(const std::vector<Simulator*>& sims, const Socket& wake, bool consume)
+{
+    const size_t N = sims.size();
+
+    PacketBatch batch;
+
+    // distinct random sequence for each thread and Simulator
+    std::vector<Impairer> impairers;
+    impairers.reserve(N);
+    for(size_t i=0; i<N; i++) {
+        epicsUInt32 seed;
+        {
+            Guard G(sims[i]->lock);
+            seed = sims[i]->impair.seed;
+        }
+        if(!seed) {
+            epicsTimeStamp now;
+            epicsTimeGetCurrent(&now);
+            seed = now.nsec ^ now.secPastEpoch;
+        }
+        impairers.push_back(Impairer((epicsUInt64(seed)<<1u) ^ epicsUInt64(size_t(&batch)) ^ i));
+    }
+
+    std::vector<pollfd> fds(N+1);
+
+    bool stop = false;
+
+    while(!stop) {
+        int timeout = -1;
+        for(size_t i=0; i<N; i++) {
+            fds[i].fd = sims[i]->serve;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0; // paranoia
+
+            int T = impairers[i].timeout();
+            if(T>=0 && (timeout<0 || T<timeout))
+                timeout = T;
+        }
+        fds[N].fd = wake;
+        fds[N].events = POLLIN;
+        fds[N].revents = 0;
+
+        int ret = ::poll(&fds[0], fds.size(), timeout);
+        if(ret<0) {
+            if(SOCKERRNO==SOCK_EINTR)
+                continue;
+            throw SocketError(SOCKERRNO);
+        }
+
+        if(fds[N].revents&(POLLERR|POLLHUP)) {
+            throw std::runtime_error("socket error from wakeupRx");
+        }
+
+        if(fds[N].revents&POLLIN) {
+            if(consume) {
+                char temp;
+                wake.recvsome(&temp, 1);
+            }
+            // otherwise leave readable so that all workers see it
+            stop = true;
+            break;
+        }
+
+        for(size_t i=0; i<N; i++) {
+            Simulator& sim = *sims[i];
+
+            if(fds[i].revents&POLLERR) {
+                throw std::runtime_error("socket error from serve");
+            }
+
+            // another worker may get there first
+            if((fds[i].revents&POLLIN) && batch.recv(sim.serve)) {
+
+                for(size_t n=0; n<batch.count; n++)
+                    batch.reply[n] = sim.handle(batch.bufs[n], batch.peers[n]);
+
+                double sd;
+                SimImpair imp;
+                {
+                    Guard G(sim.lock);
+                    sd = sim.slowdown;
+                    imp = sim.impair;
                 }
+                if(sd > 0.0)
+                    epicsThreadSleep(sd);
 
-                if(!ignore) {
-                    UnGuard U(G);
+                if(!imp.active()) {
+                    batch.send(sim.serve);
 
-                    serve.sendto(peer, buf);
+                } else {
+                    SimImpairStats stats;
+                    impairers[i].apply(imp, batch, sim.serve, stats);
+
+                    Guard G(sim.lock);
+                    sim.impair_stats.dropped += stats.dropped;
+                    sim.impair_stats.duplicated += stats.duplicated;
+                    sim.impair_stats.reordered += stats.reordered;
+                    sim.impair_stats.truncated += stats.truncated;
+                    sim.impair_stats.delayed += stats.delayed;
+                    sim.impair_stats.limited += stats.limited;
                 }
             }
+
+            impairers[i].flush(sim.serve);
         }
+    }
+}
+
+SimHost::SimHost()
+    :nthreads(1u)
+{
+    Socket::pipe(wakeupRx, wakeupTx);
+    Socket::pipe(stopRx, stopTx);
+}
+
+SimHost::~SimHost()
+{
+    for(size_t i=0; i<sims.size(); i++)
+        delete sims[i];
+}
+
+void SimHost::add(Simulator* sim)
+{
+    feed::auto_ptr<Simulator> owned(sim);
+    sims.push_back(sim);
+    owned.release();
+}
+
+void SimHost::exec()
+{
+    const unsigned N = std::max(1u, std::min(nthreads, 64u));
+    size_t nrunning = 0u;
+
+    try {
+        for(; nrunning<sims.size(); nrunning++) {
+            Simulator& sim = *sims[nrunning];
+            Guard G(sim.lock);
+            if(sim.running)
+                throw std::logic_error("Already running");
+            sim.running = true;
+            sim.serve.set_blocking(false);
+        }
+
+        serve_threads(sims, N, wakeupRx, stopTx, stopRx);
 
-        running = false;
     }catch(...){
-        running = false;
+        for(size_t i=0; i<nrunning; i++) {
+            Guard G(sims[i]->lock);
+            sims[i]->running = false;
+        }
         throw;
     }
+
+    for(size_t i=0; i<nrunning; i++) {
+        Guard G(sims[i]->lock);
+        sims[i]->running = false;
+    }
+}
+
+void SimHost::interrupt()
+{
+    char c = '!';
+
+    wakeupTx.sendall(&c, 1);
+}
+
+bool Simulator::handle(std::vector<char>& buf, const osiSockAddr& peer)
+{
+    PrintAddr addr(peer);
+
+    if(buf.size()<32) {
+        errlogPrintf("%s: ignoring too short request (%u bytes)\n",
+                     addr.c_str(), unsigned(buf.size()));
+        return false;
+    }
+
+    if(buf.size()%8) {
+        errlogPrintf("%s: sent request with %u bytes of trailing junk\n",
+                     addr.c_str(), unsigned(buf.size()%8));
+    }
+
+    bool ignore = false;
+    // errors are reported once per request, with the first offending cmd/address
+    unsigned nunknown = 0u, nunused = 0u;
+    epicsUInt32 first_unknown = 0u, first_unused = 0u;
+
+    // consecutive addresses usually fall in the same register
+    const reg_by_addr_t::Range *last = 0;
+
+    Guard G(lock);
+
+    // build reply in place
+    // leave header alone and start with first command at offset 8
+
+    for(size_t i=8; i+8<=buf.size(); i+=8) {
+        epicsUInt32 cmd_addr = ntohl(*reinterpret_cast<const epicsUInt32*>(&buf[i]));
+        epicsUInt32 data = ntohl(*reinterpret_cast<const epicsUInt32*>(&buf[i+4]));
+        const epicsUInt32 waddr = cmd_addr&0x00ffffff;
+
+        if(!last || waddr < last->base || waddr >= last->end)
+            last = reg_by_addr.find(waddr);
+
+        if(cmd_addr&0xef000000) {
+            if(!nunused++)
+                first_unused = cmd_addr;
+        }
+
+        if(!last) {
+            if(!nunknown++)
+                first_unknown = cmd_addr;
+
+            if(cmd_addr&0x10000000) {
+                data = 0xabadface;
+            }
+
+        } else {
+            SimReg& reg = *last->value;
+            size_t offset = waddr-reg.base;
+
+            if(reg.name=="ghost") {
+                // magic register name to test timeout handling
+                ignore = true;
+            }
+
+            if(cmd_addr&0x10000000) {
+                // read
+                data = reg.storage[offset];
+                if(debug)
+                    errlogPrintf("%s: read %s[%u] (%06x) -> %08x\n",
+                                 addr.c_str(),
+                                 reg.name.c_str(), unsigned(offset),
+                                 unsigned(cmd_addr), unsigned(data));
+
+                if(!reg.readable && debug) {
+                    errlogPrintf("%s: read of unreadable cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
+                }
+
+            } else {
+                // write
+                // echo back value written
+                reg_write(reg, offset, data & reg.mask);
+                if(debug)
+                    errlogPrintf("%s: write %s[%u] (%06x) <- %08x\n",
+                                 addr.c_str(),
+                                 reg.name.c_str(), unsigned(offset),
+                                 unsigned(cmd_addr), unsigned(reg.storage[offset]));
+
+                if(!reg.writable) {
+                    errlogPrintf("%s: write of unwriteable cmd/address %08x\n", addr.c_str(), unsigned(cmd_addr));
+
+                }
+            }
+        }
+
+        *reinterpret_cast<epicsUInt32*>(&buf[i+4]) = htonl(data);
+    }
+
+    if(nunused) {
+        errlogPrintf("%s: unused bits set in cmd/address %08x (and %u others)\n",
+                     addr.c_str(), unsigned(first_unused), nunused-1u);
+    }
+    if(nunknown) {
+        errlogPrintf("%s: unknown cmd/address %08x (and %u others)\n",
+                     addr.c_str(), unsigned(first_unknown), nunknown-1u);
+    }
+
+    return !ignore;
 }
 
 void Simulator::reg_write(SimReg& reg, epicsUInt32 offset, epicsUInt32 newval)
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include <epicsTypes.h>
 #include <osiSock.h>
@@ -13,6 +14,7 @@
 
 #include "utils.h"
 #include "jblob.h"
+#include "addrindex.h"
 
 struct SimReg {
     std::string name;
@@ -32,6 +34,42 @@ struct SimReg {
     inline const epicsUInt32& operator[](size_t idx) const { return storage.at(idx); }
 };
 
+// Network impairments applied to replies
+struct epicsShareClass SimImpair {
+    double drop,      // probability [0, 1] that a reply is not sent
+           duplicate, // probability that a reply is sent twice
+           reorder,   // probability that a reply is held until after the next
+           truncate;  // probability that a reply is cut short
+    enum delay_t {
+        None,
+        Fixed,   // delay_min
+        Uniform, // [delay_min, delay_max)
+        Pareto,  // scale delay_min, shape pareto_alpha, capped at delay_max (if >0)
+    } delay;
+    double delay_min, delay_max, pareto_alpha;
+    // max replies per second per thread.  Excess replies are dropped. 0 - no limit
+    double rate;
+    // random number seed.  0 - seed from time
+    epicsUInt32 seed;
+
+    SimImpair() { clear(); }
+    void clear();
+    bool active() const;
+
+    // Parse comma separated list of key=value
+    //   drop=, dup=, reorder=, trunc= probabilities
+    //   delay=<sec>, delay=uniform:<min>:<max>, delay=pareto:<scale>:<alpha>[:<max>]
+    //   rate=<replies/sec>, seed=<int>
+    // eg. "drop=0.01,delay=pareto:0.0005:1.5:0.1"
+    void parse(const std::string& spec);
+};
+
+// counts of impairments applied
+struct SimImpairStats {
+    size_t dropped, duplicated, reordered, truncated, delayed, limited;
+    SimImpairStats() :dropped(0u), duplicated(0u), reordered(0u), truncated(0u), delayed(0u), limited(0u) {}
+};
+
 class epicsShareClass Simulator
 {
 public:
@@ -53,7 +91,8 @@ public:
     // eg. after passing port 0 to ctor, use this to find the randomly assigned port
     void endpoint(osiSockAddr&);
     // begin receiving and processing messages.
-    // Doesn't return until interrupt() is called
+    // Doesn't return until interrupt() is called.
+    // Runs nworkers-1 additional threads.
     void exec();
     // cause exec() to return.
     // Calls to interrupt() are queued.
@@ -67,22 +106,38 @@ public:
     bool debug;
     // arbitrary slowdown before sending reply
     double slowdown;
+    // number of threads serving requests.  Set before exec().  Default 1
+    unsigned nworkers;
+    // faults injected into replies.  May be changed while running (take lock)
+    SimImpair impair;
+    SimImpairStats impair_stats;
     // guard access  to register values
     epicsMutex lock;
+    // process one request in place, replacing data with reply.
+    // Returns false if no reply should be sent.  Takes lock.
+    bool handle(std::vector<char>& buf, const osiSockAddr& peer);
+
+    // receive, handle, and reply for all sims until 'wake' is readable.
+    // Used by exec() and SimHost::exec() threads.
+    // consume - read one byte from 'wake' before returning
+    static void serve_loop(const std::vector<Simulator*>& sims, const Socket& wake, bool consume);
 protected:
     virtual void reg_write(SimReg& reg, epicsUInt32 offset, epicsUInt32 newval);
 
 private:
+    friend class SimHost;
     bool running;
 
     typedef std::map<std::string, SimReg> reg_by_name_t;
     reg_by_name_t reg_by_name;
 
     // borrows storage from reg_by_name
-    typedef std::map<epicsUInt32, SimReg*> reg_by_addr_t;
+    typedef AddrIndex<SimReg*> reg_by_addr_t;
     reg_by_addr_t reg_by_addr;
 
     Socket serve, wakeupRx, wakeupTx;
+    // stops exec() worker threads
+    Socket stopRx, stopTx;
     osiSockAddr serveaddr;
 
 public:
@@ -91,6 +146,36 @@ public:
     iterator end() { return reg_by_name.end(); }
 };
 
+// Serve many Simulators from one pool of threads
+class epicsShareClass SimHost
+{
+public:
+    SimHost();
+    ~SimHost();
+
+    // takes ownership.  Call before exec()
+    void add(Simulator* sim);
+
+    // begin receiving and processing messages for all Simulators.
+    // Doesn't return until interrupt() is called.
+    void exec();
+    // cause exec() to return.
+    void interrupt();
+
+    // number of threads serving requests.  Set before exec().  Default 1
+    unsigned nthreads;
+
+    size_t size() const { return sims.size(); }
+    Simulator& operator[](size_t i) { return *sims.at(i); }
+
+private:
+    std::vector<Simulator*> sims;
+    Socket wakeupRx, wakeupTx, stopRx, stopTx;
+
+    SimHost(const SimHost&);
+    SimHost& operator=(const SimHost&);
+};
+
 class epicsShareClass Simulator_RFS : public Simulator
 {
 public:
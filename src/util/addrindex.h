@@ -0,0 +1,108 @@
+#ifndef ADDRINDEX_H
+#define ADDRINDEX_H
+
+#include <vector>
+#include <algorithm>
+
+#include <epicsTypes.h>
+
+// Sorted index of non-overlapping address ranges [base, base+count).
+// Lookup by address is O(log R) with R ranges.  No per-address storage.
+// Intended to be built once, then searched many times.
+template<typename T>
+class AddrIndex
+{
+public:
+    struct Range {
+        epicsUInt32 base;
+        epicsUInt64 end; // one past last address
+        T value;
+    };
+    typedef std::vector<Range> ranges_t;
+    typedef typename ranges_t::const_iterator const_iterator;
+
+    // Add a range.  Where it overlaps existing ranges, the new range takes precedence.
+    // Returns the number of addresses overlapped.
+    // If provided, the values of overlapped ranges are appended to 'displaced'.
+    size_t insert(epicsUInt32 base, epicsUInt64 count, const T& value, std::vector<T>* displaced=0)
+    {
+        Range ent;
+        ent.base = base;
+        ent.end = epicsUInt64(base)+count;
+        ent.value = value;
+
+        if(count==0u)
+            return 0u;
+
+        // first range which might overlap
+        typename ranges_t::iterator it(std::lower_bound(ranges.begin(), ranges.end(), base, end_le()));
+
+        size_t overlap = 0u;
+        ranges_t keep;
+
+        while(it!=ranges.end() && it->base < ent.end) {
+            Range cur(*it);
+            epicsUInt64 olow = std::max(epicsUInt64(cur.base), epicsUInt64(ent.base)),
+                        ohigh = std::min(cur.end, ent.end);
+            overlap += ohigh - olow;
+            if(displaced)
+                displaced->push_back(cur.value);
+
+            if(cur.base < ent.base) {
+                // keep lower part
+                Range low(cur);
+                low.end = ent.base;
+                keep.push_back(low);
+            }
+            if(cur.end > ent.end) {
+                // keep upper part
+                Range high(cur);
+                high.base = epicsUInt32(ent.end);
+                keep.push_back(high);
+            }
+            it = ranges.erase(it);
+        }
+
+        keep.push_back(ent);
+        std::sort(keep.begin(), keep.end(), base_lt());
+
+        it = std::lower_bound(ranges.begin(), ranges.end(), keep.front(), base_lt());
+        ranges.insert(it, keep.begin(), keep.end());
+
+        return overlap;
+    }
+
+    // returns NULL if no range contains addr
+    const Range* find(epicsUInt32 addr) const
+    {
+        const_iterator it(std::upper_bound(ranges.begin(), ranges.end(), addr, base_gt()));
+        if(it==ranges.begin())
+            return 0;
+        --it;
+        if(addr < it->end)
+            return &*it;
+        return 0;
+    }
+
+    void clear() { ranges.clear(); }
+    size_t size() const { return ranges.size(); }
+    const_iterator begin() const { return ranges.begin(); }
+    const_iterator end() const { return ranges.end(); }
+
+private:
+    ranges_t ranges;
+
+    struct base_lt {
+        bool operator()(const Range& lhs, const Range& rhs) const { return lhs.base < rhs.base; }
+    };
+    // for upper_bound(addr)
+    struct base_gt {
+        bool operator()(epicsUInt32 addr, const Range& rhs) const { return addr < rhs.base; }
+    };
+    // for lower_bound(addr) to find the first range ending after addr
+    struct end_le {
+        bool operator()(const Range& lhs, epicsUInt32 addr) const { return lhs.end <= addr; }
+    };
+};
+
+#endif // ADDRINDEX_H
@@ -0,0 +1,565 @@
+
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+
+#include <errlog.h>
+#include <yajl_parse.h>
+
+#include <epicsStdlib.h>
+
+#include "utils.h"
+#include "jregtable.h"
+
+namespace {
+
+// undef implies API version 0
+#ifndef EPICS_YAJL_VERSION
+typedef long integer_arg;
+typedef unsigned size_arg;
+#else
+typedef long long integer_arg;
+typedef size_t size_arg;
+#endif
+
+struct Header {
+    char magic[4];
+    epicsUInt32 version; // also detects foreign byte order
+    epicsUInt32 nregs, ninfo;
+    epicsUInt32 names_off, names_len;
+    epicsUInt32 descs_off, descs_len;
+};
+
+const char magic[4] = {'F', 'J', 'R', 'T'};
+const epicsUInt32 version = 1u;
+
+inline
+bool keyeq(const std::string& key, const char *lit)
+{
+    return key.compare(lit)==0;
+}
+
+struct context {
+    // not sorted until finish()
+    std::vector<JRegTable::Entry> regs;
+    std::vector<JRegTable::Info> infos;
+    std::vector<char> names, descs;
+
+    std::string err, // error message
+                regname,
+                param,
+                sval;
+    unsigned depth;
+    bool in_metadata;
+
+    bool ignore_scratch;
+    JRegTable::Entry scratch;
+    size_t desc_mark;
+
+    void warn(const std::string& msg) {
+        errlogPrintf("FEED JSON warning: %s\n", msg.c_str());
+    }
+
+    void clear_scratch() {
+        memset(&scratch, 0, sizeof(scratch));
+        desc_mark = descs.size();
+    }
+
+    epicsUInt32 add_name(const char *name, size_t len) {
+        epicsUInt32 ret = names.size();
+        names.insert(names.end(), name, name+len);
+        names.push_back('\0');
+        return ret;
+    }
+
+    context() :depth(0), in_metadata(false), ignore_scratch(false) { clear_scratch(); }
+
+    void finish(std::vector<char>& out);
+};
+
+#define TRY context *self = static_cast<context*>(ctx); try
+
+#define CATCH() catch(std::exception& e) { if(self->err.empty()) self->err = e.what(); return 0; }
+
+int jtab_null(void *ctx)
+{
+    TRY {
+        self->warn("ignoring unsupported: null");
+        return 1;
+    }CATCH()
+}
+
+int jtab_boolean(void *ctx, int val)
+{
+    TRY {
+        self->warn(SB()<<"ignoring unsupported: boolean value "<<val);
+        return 1;
+    }CATCH()
+}
+
+int jtab_integer(void *ctx, integer_arg val)
+{
+    TRY {
+        if(self->depth==2) {
+            if(self->in_metadata) {
+                JRegTable::Info info;
+                info.name_len = self->param.size();
+                info.name_off = self->add_name(self->param.c_str(), self->param.size());
+                info.value = val;
+                self->infos.push_back(info);
+
+            } else if(keyeq(self->param, "base_addr")) {
+                if(val&0xff000000) {
+                    self->ignore_scratch = true;
+                    self->warn(SB()<<self->regname<<"."<<self->param<<" ignores out of range base_addr");
+                } else {
+                    self->scratch.base_addr = val;
+                }
+
+            } else if(keyeq(self->param, "addr_width")) {
+                if(val>32) {
+                    self->ignore_scratch = true;
+                    self->warn(SB()<<self->regname<<"."<<self->param<<" ignores out of range addr_width");
+                } else {
+                    self->scratch.addr_width = val;
+                }
+
+            } else if(keyeq(self->param, "data_width")) {
+                if(val>32) {
+                    self->ignore_scratch = true;
+                    self->warn(SB()<<self->regname<<"."<<self->param<<" ignores out of range data_width");
+                } else {
+                    self->scratch.data_width = val;
+                }
+
+            } else {
+                self->warn(SB()<<self->regname<<"."<<self->param<<" ignores integer value");
+            }
+        } else
+            self->warn(SB()<<"ignored integer value at depth="<<self->depth);
+        return 1;
+    }CATCH()
+}
+
+int jtab_double(void *ctx, double val)
+{
+    TRY {
+        self->warn(SB()<<"ignoring unsupported: double value "<<val);
+        return 1;
+    }CATCH()
+}
+
+int jtab_string(void *ctx, const unsigned char *val, size_arg len)
+{
+    TRY {
+        const char *V = (const char*)val;
+
+        if(self->depth==2) {
+            if(self->in_metadata) {
+                // TODO handle string metadata?
+                // until then, silently ignore as this might be interesting
+                // to scripts
+            } else if(keyeq(self->param, "access")) {
+                self->scratch.access = 0u;
+                if(memchr(V, 'r', len))
+                    self->scratch.access |= 1u;
+                if(memchr(V, 'w', len))
+                    self->scratch.access |= 2u;
+
+            } else if(keyeq(self->param, "description")) {
+                self->scratch.desc_off = self->descs.size();
+                self->scratch.desc_len = len;
+                self->descs.insert(self->descs.end(), V, V+len);
+
+            } else if(keyeq(self->param, "sign")) {
+                if(len==8 && memcmp(V, "unsigned", 8)==0) {
+                    self->scratch.sign = JRegister::Unsigned;
+
+                } else if(len==6 && memcmp(V, "signed", 6)==0) {
+                    self->scratch.sign = JRegister::Signed;
+
+                } else {
+                    self->warn(SB()<<self->regname<<"."<<self->param<<" unknown value "<<std::string(V, len)<<" assume Unsigned");
+                }
+
+            } else {
+                // try to parse any unknown strings as integers
+                self->sval.assign(V, len);
+                epicsInt32 ival = 0;
+                if(epicsParseInt32(self->sval.c_str(), &ival, 0, 0)) {
+                    self->warn(SB()<<self->regname<<"."<<self->param<<" unable to parse string value '"<<self->sval<<"' as integer");
+
+                } else {
+                    return jtab_integer(ctx, ival);
+                }
+            }
+        } else
+            self->warn(SB()<<"ignored string value at depth="<<self->depth);
+        return 1;
+    }CATCH()
+}
+
+int jtab_start_map(void *ctx)
+{
+    TRY {
+        self->depth++;
+        if(self->depth==2)
+            self->ignore_scratch = false; // starting a new register
+        if(self->depth>2) {
+            throw std::runtime_error("Object depth limit (2) exceeded");
+        }
+        return 1;
+    }CATCH()
+}
+
+int jtab_map_key(void *ctx, const unsigned char *key, size_arg len)
+{
+    TRY {
+        if(len==0)
+            throw std::runtime_error("Zero length key not allowed");
+        if(self->depth==1) {
+            self->regname.assign((const char*)key, len);
+            if(keyeq(self->regname, "__metadata__")) {
+                self->in_metadata = true;
+            }
+            // duplicates detected by finish()
+        } else if(self->depth==2) {
+            self->param.assign((const char*)key, len);
+        } else {
+            throw std::logic_error("key at unsupported depth");
+        }
+        return 1;
+    }CATCH()
+}
+
+int jtab_end_map(void *ctx)
+{
+    TRY {
+        if(self->depth==2) {
+            if(self->in_metadata) {
+                // not a register
+            } else if(self->ignore_scratch) {
+                self->warn(SB()<<"Ignore illformed definition for register "<<self->regname);
+                self->descs.resize(self->desc_mark);
+
+            } else {
+                // ignore register definitions when some important part was incorrectly formatted
+                self->scratch.name_len = self->regname.size();
+                self->scratch.name_off = self->add_name(self->regname.c_str(), self->regname.size());
+                self->regs.push_back(self->scratch);
+            }
+            self->ignore_scratch = false;
+            self->in_metadata = false;
+            self->clear_scratch();
+        }
+        if(self->depth==0)
+            throw std::logic_error("Object depth underflow");
+        self->depth--;
+        return 1;
+    }CATCH()
+}
+
+yajl_callbacks jtab_cbs = {
+    &jtab_null, // null
+    &jtab_boolean, // boolean
+    &jtab_integer,
+    &jtab_double, // double
+    NULL, // number
+    &jtab_string,
+    &jtab_start_map,
+    &jtab_map_key,
+    &jtab_end_map,
+    NULL, // start array
+    NULL, // end array
+};
+
+struct handler {
+    yajl_handle handle;
+    explicit handler(yajl_handle handle) :handle(handle)
+    {
+        if(!handle)
+            throw std::runtime_error("Failed to allocate yajl handle");
+    }
+    ~handler() {
+        yajl_free(handle);
+    }
+    operator yajl_handle() { return handle; }
+};
+
+// order by name in a pool
+template<typename E>
+struct by_name {
+    const char *pool;
+    explicit by_name(const char *pool) :pool(pool) {}
+    bool operator()(const E& lhs, const E& rhs) const {
+        int ret = memcmp(pool+lhs.name_off, pool+rhs.name_off, std::min(lhs.name_len, rhs.name_len));
+        return ret<0 || (ret==0 && lhs.name_len<rhs.name_len);
+    }
+};
+
+// stable sort by name, then remove duplicates keeping the last definition.
+// returns the number of duplicates
+template<typename E>
+size_t sort_unique(std::vector<E>& vec, const std::vector<char>& names, bool warn)
+{
+    if(vec.empty())
+        return 0u;
+
+    const by_name<E> cmp(&names[0]);
+    std::stable_sort(vec.begin(), vec.end(), cmp);
+
+    size_t out = 0u;
+    for(size_t in=1u; in<vec.size(); in++) {
+        if(!cmp(vec[out], vec[in])) {
+            // equal names, later definition replaces
+            if(warn)
+                errlogPrintf("FEED JSON warning: Duplicate definition for register %s\n", &names[vec[in].name_off]);
+        } else {
+            out++;
+        }
+        vec[out] = vec[in];
+    }
+    size_t ndup = vec.size()-out-1u;
+    vec.resize(out+1u);
+    return ndup;
+}
+
+void context::finish(std::vector<char>& out)
+{
+    sort_unique(regs, names, true);
+    sort_unique(infos, names, false);
+
+    Header head;
+    memcpy(head.magic, magic, 4);
+    head.version = version;
+    head.nregs = regs.size();
+    head.ninfo = infos.size();
+    head.names_off = sizeof(Header) + regs.size()*sizeof(JRegTable::Entry) + infos.size()*sizeof(JRegTable::Info);
+    head.names_len = names.size();
+    head.descs_off = head.names_off + ((names.size()+3u)&~3u);
+    head.descs_len = descs.size();
+
+    out.clear();
+    out.resize(head.descs_off + descs.size(), 0);
+
+    char *pos = &out[0];
+    memcpy(pos, &head, sizeof(head));
+    pos += sizeof(head);
+    if(!regs.empty())
+        memcpy(pos, &regs[0], regs.size()*sizeof(regs[0]));
+    pos += regs.size()*sizeof(JRegTable::Entry);
+    if(!infos.empty())
+        memcpy(pos, &infos[0], infos.size()*sizeof(infos[0]));
+    if(!names.empty())
+        memcpy(&out[head.names_off], &names[0], names.size());
+    if(!descs.empty())
+        memcpy(&out[head.descs_off], &descs[0], descs.size());
+}
+
+} // namespace
+
+JRegTable::JRegTable()
+    :base(0)
+    ,len(0u)
+{
+    context empty;
+    empty.finish(storage);
+    base = &storage[0];
+    len = storage.size();
+}
+
+void JRegTable::parse(const char *buf)
+{
+    parse(buf, strlen(buf));
+}
+
+void JRegTable::parse(const char *buf, size_t buflen)
+{
+#ifndef EPICS_YAJL_VERSION
+    yajl_parser_config conf;
+    memset(&conf, 0, sizeof(conf));
+    conf.allowComments = 1;
+    conf.checkUTF8 = 1;
+#endif
+
+    context ctxt;
+
+#ifndef EPICS_YAJL_VERSION
+    handler handle(yajl_alloc(&jtab_cbs, &conf, NULL, &ctxt));
+#else
+    handler handle(yajl_alloc(&jtab_cbs, NULL, &ctxt));
+#endif
+
+    yajl_status sts = yajl_parse(handle, (const unsigned char*)buf, buflen);
+#ifndef EPICS_YAJL_VERSION
+    if(sts==yajl_status_insufficient_data) {
+        sts = yajl_parse_complete(handle);
+    }
+#else
+    if(sts==yajl_status_ok)
+        sts = yajl_complete_parse(handle);
+#endif
+    switch(sts) {
+    case yajl_status_ok:
+        break;
+    case yajl_status_error: {
+        std::string msg;
+        unsigned char *raw = yajl_get_error(handle, 1, (const unsigned char*)buf, buflen);
+        try {
+            msg = (char*)raw;
+            yajl_free_error(handle, raw);
+        }catch(...){
+            yajl_free_error(handle, raw);
+            throw;
+        }
+        throw std::runtime_error(msg);
+    }
+    case yajl_status_client_canceled:
+        throw std::runtime_error(ctxt.err);
+#ifndef EPICS_YAJL_VERSION
+    case yajl_status_insufficient_data:
+        throw std::runtime_error("Unexpected end of input");
+#endif
+    }
+
+    std::vector<char> temp;
+    ctxt.finish(temp);
+
+    storage.swap(temp);
+    base = &storage[0];
+    len = storage.size();
+}
+
+void JRegTable::load(const char *buf, size_t buflen)
+{
+    // validate before copying
+    JRegTable temp;
+    temp.attach(buf, buflen);
+
+    std::vector<char> copy(buf, buf+buflen);
+    storage.swap(copy);
+    base = &storage[0];
+    len = storage.size();
+}
+
+void JRegTable::attach(const char *buf, size_t buflen)
+{
+    Header head;
+    if(buflen<sizeof(head))
+        throw std::runtime_error("JRegTable image truncated");
+    memcpy(&head, buf, sizeof(head));
+
+    if(memcmp(head.magic, magic, 4)!=0)
+        throw std::runtime_error("Not a JRegTable image");
+    else if(head.version!=version)
+        throw std::runtime_error(SB()<<"JRegTable image version "<<head.version<<" not supported");
+
+    size_t names_off = sizeof(Header) + size_t(head.nregs)*sizeof(Entry) + size_t(head.ninfo)*sizeof(Info);
+    if(head.names_off!=names_off
+            || head.descs_off < head.names_off + head.names_len
+            || head.descs_off + size_t(head.descs_len) > buflen
+            || (head.names_len && buf[head.names_off+head.names_len-1u]!='\0'))
+        throw std::runtime_error("JRegTable image corrupt");
+
+    const Entry *regs = reinterpret_cast<const Entry*>(buf+sizeof(Header));
+    for(size_t i=0; i<head.nregs; i++) {
+        if(size_t(regs[i].name_off) + regs[i].name_len >= head.names_len
+                || size_t(regs[i].desc_off) + regs[i].desc_len > head.descs_len)
+            throw std::runtime_error("JRegTable image corrupt");
+    }
+    const Info *infos = reinterpret_cast<const Info*>(buf+sizeof(Header)+head.nregs*sizeof(Entry));
+    for(size_t i=0; i<head.ninfo; i++) {
+        if(size_t(infos[i].name_off) + infos[i].name_len >= head.names_len)
+            throw std::runtime_error("JRegTable image corrupt");
+    }
+
+    std::vector<char> empty;
+    storage.swap(empty);
+    base = buf;
+    len = buflen;
+}
+
+size_t JRegTable::nregs() const
+{
+    return reinterpret_cast<const Header*>(base)->nregs;
+}
+
+const JRegTable::Entry& JRegTable::entry(size_t i) const
+{
+    return reinterpret_cast<const Entry*>(base+sizeof(Header))[i];
+}
+
+const char* JRegTable::pool(epicsUInt32 off) const
+{
+    return base + reinterpret_cast<const Header*>(base)->names_off + off;
+}
+
+const char* JRegTable::name(size_t i) const
+{
+    return pool(entry(i).name_off);
+}
+
+std::string JRegTable::description(size_t i) const
+{
+    const Entry& ent = entry(i);
+    const char *descs = base + reinterpret_cast<const Header*>(base)->descs_off;
+    return std::string(descs+ent.desc_off, ent.desc_len);
+}
+
+void JRegTable::get(size_t i, JRegister& reg) const
+{
+    const Entry& ent = entry(i);
+    reg.name.assign(name(i), ent.name_len);
+    reg.description = description(i);
+    reg.base_addr = ent.base_addr;
+    reg.addr_width = ent.addr_width;
+    reg.data_width = ent.data_width;
+    reg.sign = ent.sign ? JRegister::Signed : JRegister::Unsigned;
+    reg.readable = ent.access&1u;
+    reg.writable = ent.access&2u;
+}
+
+size_t JRegTable::find(const char *name, size_t namelen) const
+{
+    const Entry *regs = &entry(0);
+    size_t low = 0u, high = nregs();
+
+    while(low<high) {
+        size_t mid = low + (high-low)/2u;
+        const Entry& ent = regs[mid];
+
+        int ret = memcmp(pool(ent.name_off), name, std::min(size_t(ent.name_len), namelen));
+        if(ret==0 && ent.name_len==namelen)
+            return mid;
+        else if(ret<0 || (ret==0 && ent.name_len<namelen))
+            low = mid+1u;
+        else
+            high = mid;
+    }
+    return nregs();
+}
+
+size_t JRegTable::ninfo() const
+{
+    return reinterpret_cast<const Header*>(base)->ninfo;
+}
+
+const char* JRegTable::info_name(size_t i) const
+{
+    const Info *infos = reinterpret_cast<const Info*>(base+sizeof(Header)+nregs()*sizeof(Entry));
+    return pool(infos[i].name_off);
+}
+
+epicsInt32 JRegTable::info_value(size_t i) const
+{
+    const Info *infos = reinterpret_cast<const Info*>(base+sizeof(Header)+nregs()*sizeof(Entry));
+    return infos[i].value;
+}
+
+void JRegTable::get(JBlob::info32_t& info32) const
+{
+    JBlob::info32_t temp;
+    for(size_t i=0, N=ninfo(); i<N; i++)
+        temp[info_name(i)] = info_value(i);
+    info32.swap(temp);
+}
@@ -0,0 +1,80 @@
+#ifndef JREGTABLE_H
+#define JREGTABLE_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <shareLib.h>
+
+#include "jblob.h"
+
+// Compact register table parsed from the same JSON as JBlob.
+//
+// All contents are kept in a single contiguous image:
+//   header, Entry[nregs] sorted by name, Info[ninfo] sorted by name,
+//   name pool, description pool.
+// Names are nil terminated.  Host byte order.
+// The image may be saved and re-loaded, or used in place (eg. mmap()'d).
+struct epicsShareClass JRegTable
+{
+    struct Entry {
+        epicsUInt32 name_off, name_len;
+        epicsUInt32 desc_off, desc_len;
+        epicsUInt32 base_addr;
+        epicsUInt8  addr_width,
+                    data_width,
+                    sign, // JRegister::sign_t
+                    access; // bit 0 readable, bit 1 writable
+    };
+
+    // __metadata__
+    struct Info {
+        epicsUInt32 name_off, name_len;
+        epicsInt32 value;
+    };
+
+    JRegTable();
+
+    // Parse and replace current contents.
+    // Same semantics, and warnings, as JBlob::parse()
+    // except that __metadata__ does not appear as a register.
+    void parse(const char *buf);
+    void parse(const char *buf, size_t buflen);
+
+    // serialized image
+    const char* data() const { return base; }
+    size_t size() const { return len; }
+
+    // replace contents with a copy of an image
+    void load(const char *buf, size_t buflen);
+    // replace contents with a reference to an image, which must out-live this JRegTable.
+    // throws std::runtime_error if image is invalid
+    void attach(const char *buf, size_t buflen);
+
+    size_t nregs() const;
+    const Entry& entry(size_t i) const;
+    const char* name(size_t i) const;
+    // descriptions are only copied out on request
+    std::string description(size_t i) const;
+    // fill in all fields
+    void get(size_t i, JRegister& reg) const;
+
+    // returns nregs() if not found
+    size_t find(const char *name, size_t namelen) const;
+    size_t find(const std::string& name) const { return find(name.c_str(), name.size()); }
+
+    size_t ninfo() const;
+    const char* info_name(size_t i) const;
+    epicsInt32 info_value(size_t i) const;
+    void get(JBlob::info32_t& info32) const;
+
+private:
+    std::vector<char> storage; // empty when attach()'d
+    const char *base;
+    size_t len;
+
+    const char *pool(epicsUInt32 off) const;
+};
+
+#endif // JREGTABLE_H
@@ -36,173 +36,251 @@ unsigned unhexchar(char c)
         return 0;
 }
 
-void ROM::parse(const char* buf, size_t buflen, bool swap)
+void ROMView::Entry::copy(std::vector<char>& out) const
 {
-    const char* const orig = buf;
+    out.resize(nbytes);
+    for(size_t i=0; i<nbytes; i+=2) {
+        out[i+0] = (*this)[i+0];
+        out[i+1] = (*this)[i+1];
+    }
+}
 
-    infos_t temp;
+void ROMView::Entry::decode(std::string& out) const
+{
+    switch(type) {
+    case ROMDescriptor::Invalid:
+        out.clear();
+        break;
+
+    case ROMDescriptor::Text: {
+        size_t len = 0u;
+        while(len<nbytes && (*this)[len]!='\0')
+            len++;
+        out.resize(len);
+        for(size_t i=0; i<len; i++)
+            out[i] = (*this)[i];
+        break;
+    }
 
-    while(buflen>=4) {
-        // only lower 2 bytes are used
-        epicsUInt32 val(*reinterpret_cast<const epicsUInt32*>(buf));
-        if(swap)
-            val = ntohl(val);
+    case ROMDescriptor::BigInt:
+        out.resize(nbytes*2u); // 2 hex chars per byte
+        for(size_t i=0; i<nbytes; i++) {
+            unsigned char B = (*this)[i];
 
-        if(val&0xffff0000) {
-            throw std::runtime_error("Does not look like ROM contents (high word set)");
+            out[2*i+0] = hexchar(B>>4);
+            out[2*i+1] = hexchar(B>>0);
         }
+        break;
+
+    case ROMDescriptor::JSON: {
+        std::vector<char> json, scratch;
+        ZInflater Z;
+        inflate(json, scratch, Z);
+        out.assign(json.begin(), json.end());
+        break;
+    }
+    }
+}
 
-        unsigned type = val>>14;
-        unsigned size = (val&0x3fff)*4u; // units of bytes (including unused upper bytes)
-
-        buf+=4;
-        buflen-=4;
+void ROMView::Entry::inflate(std::vector<char>& out, std::vector<char>& scratch, ZInflater& Z) const
+{
+    copy(scratch);
+    Z.inflate(out, &scratch[0], scratch.size());
+}
 
-        if(type==0)
-            break;
+ROMView::const_iterator::const_iterator(const char *buf, size_t buflen, bool swap)
+    :orig(buf)
+    ,pos(buf)
+    ,remaining(buflen)
+{
+    cur.swap = swap;
+    next();
+}
 
-        if(size>buflen) {
-            errlogPrintf("Warning: FEED ROM contents truncated at %u (remaining %u)."
-                         "  ignoring a type=%u size=%u bytes\n",
-                         unsigned(buf-orig), unsigned(buflen), type, size);
-            break;
-        }
+void ROMView::const_iterator::next()
+{
+    if(remaining<4) {
+        pos = 0;
+        return;
+    }
 
-        std::vector<char> contents(size/2u); // copy excluding unused upper bytes
+    // only lower 2 bytes are used
+    epicsUInt32 val;
+    memcpy(&val, pos, 4);
+    if(cur.swap)
+        val = ntohl(val);
 
-        for(unsigned i=0; i<contents.size(); i+=2) {
-            if(swap) {
-                contents[i+0] = buf[2*i+2];
-                contents[i+1] = buf[2*i+3];
-            } else {
-                contents[i+0] = buf[2*i+1];
-                contents[i+1] = buf[2*i+0];
-            }
-        }
+    if(val&0xffff0000) {
+        pos = 0;
+        throw std::runtime_error("Does not look like ROM contents (high word set)");
+    }
 
-        ROMDescriptor desc;
-        desc.type = (ROMDescriptor::type_t)type;
+    unsigned type = val>>14;
+    unsigned size = (val&0x3fff)*4u; // units of bytes (including unused upper bytes)
 
-        switch(desc.type) {
-        case ROMDescriptor::Invalid:
-            break; // already handled above
+    if(type==0) {
+        pos = 0;
+        return;
+    }
 
-        case ROMDescriptor::Text:
-            desc.value = std::string(&contents[0], strnlen(&contents[0], contents.size()));
-            break;
+    if(size>remaining-4u) {
+        errlogPrintf("Warning: FEED ROM contents truncated at %u (remaining %u)."
+                     "  ignoring a type=%u size=%u bytes\n",
+                     unsigned(pos+4-orig), unsigned(remaining-4u), type, size);
+        pos = 0;
+        return;
+    }
 
-        case ROMDescriptor::BigInt: {
-            std::vector<char> cbuf(contents.size()*2u); // 2 hex chars per byte
+    cur.type = (ROMDescriptor::type_t)type;
+    cur.payload = pos+4;
+    cur.nbytes = size/2u;
+}
 
-            for(unsigned i=0; i<contents.size(); i++) {
-                unsigned char B = contents[i];
+ROMView::const_iterator& ROMView::const_iterator::operator++()
+{
+    if(pos) {
+        size_t size = 4u + cur.nbytes*2u;
+        pos += size;
+        remaining -= size;
+        next();
+    }
+    return *this;
+}
 
-                cbuf[2*i+0] = hexchar(B>>4);
-                cbuf[2*i+1] = hexchar(B>>0);
-            }
-            desc.value = std::string(&cbuf[0], cbuf.size());
-            break;
-        }
+void ROM::parse(const char* buf, size_t buflen, bool swap)
+{
+    infos_t temp;
 
-        case ROMDescriptor::JSON: {
-            std::vector<char> json;
+    std::vector<char> json, scratch;
+    ZInflater Z;
 
-            zinflate(json, &contents[0], contents.size());
+    ROMView view(buf, buflen, swap);
 
-            desc.value = std::string(&json[0], json.size());
-            break;
-        }
-        }
+    for(ROMView::const_iterator it(view.begin()), end(view.end()); it!=end; ++it)
+    {
+        const ROMView::Entry& entry = *it;
 
-        temp.push_back(desc);
+        temp.push_back(ROMDescriptor());
+        ROMDescriptor& desc = temp.back();
+        desc.type = entry.type;
 
-        buf += size;
-        buflen -= size;
+        if(entry.type==ROMDescriptor::JSON) {
+            entry.inflate(json, scratch, Z);
+            desc.value.assign(json.begin(), json.end());
+        } else {
+            entry.decode(desc.value);
+        }
     }
 
     infos.swap(temp);
 }
 
-size_t ROM::prepare(epicsUInt32* buf, size_t count)
-{
-    size_t ret = prepare(reinterpret_cast<char*>(buf), count*4u);
-    for(size_t i=0; i<count; i++) {
-        buf[i] = ntohl(buf[i]);
-    }
-    return ret/4u;
-}
+ROMWriter::ROMWriter(char* buf, size_t buflen)
+    :orig(buf)
+    ,buf(buf)
+    ,buflen(buflen)
+    ,Z(9)
+{}
 
-size_t ROM::prepare(char* buf, size_t buflen)
+void ROMWriter::put(ROMDescriptor::type_t t, const char *payload, size_t len)
 {
-    const char* const orig = buf;
-    const size_t origlen = buflen;
+    // pad to even length
+    const size_t nwords = (len+1u)/2u;
 
-    for(infos_t::const_iterator it=infos.begin(), end=infos.end(); it!=end; ++it)
-    {
-        std::vector<char> contents;
-
-        const ROMDescriptor& info = *it;
-        switch(info.type) {
-        case ROMDescriptor::Invalid:
-            throw std::logic_error("ROM can't contain Invalid ROMDescriptor");
-
-        case ROMDescriptor::Text:
-            contents.resize(info.value.size());
-
-            memcpy(&contents[0], info.value.c_str(), contents.size());
-
-            break;
-        case ROMDescriptor::BigInt:
-            contents.resize(info.value.size()/2u, 0u);
-            if(info.value.size()%2u)
-                contents.resize(contents.size()+1, 0u);
-
-            for(size_t i=0; i<info.value.size(); i++) {
-                unsigned val =unhexchar(info.value[i]);
-                if((i%2u)==0)
-                    val <<= 4;
-                contents[i/2] |= val;
-            }
-            break;
-        case ROMDescriptor::JSON:
-            zdeflate(contents, info.value.c_str(), info.value.size(), 9);
-            break;
-        }
+    // check that word size in header won't overflow
+    if(nwords >= 0x4000)
+        throw std::runtime_error(SB()<<"Descriptor type="<<t<<" too large size="<<(2u*nwords));
 
-        if(contents.size()%2)
-            contents.push_back('\0');
+    // check for space in output buffer
+    if(4u+nwords*4u>buflen)
+        throw std::runtime_error(SB()<<"Not enough space to encode ROM contents at "
+                                 <<(buf-orig)<<" have "<<buflen<<" need "<<(4u+nwords*4u));
 
-        // check that word size in header won't overflow
-        if(contents.size()/2u >= 0x4000)
-            throw std::runtime_error(SB()<<"Descriptor type="<<info.type<<" too large size="<<contents.size());
+    epicsUInt32 header = htonl((t<<14) | nwords);
+    memcpy(buf, &header, 4);
+    buf += 4;
+    buflen -= 4;
+
+    for(size_t i=0; i<nwords; i++)
+    {
+        buf[4*i+0] = buf[4*i+1] = 0;
+        buf[4*i+2] = payload[2*i+0];
+        buf[4*i+3] = 2*i+1<len ? payload[2*i+1] : '\0';
+    }
+
+    buf += nwords*4u;
+    buflen -= nwords*4u;
+}
 
-        // check for space in output buffer
-        if(4u+contents.size()*2u>buflen)
-            throw std::runtime_error(SB()<<"Not enough space to encode ROM contents at "
-                                     <<(buf-orig)<<" have "<<buflen<<" need "<<(4u+contents.size()*2u));
+void ROMWriter::text(const char *str, size_t len)
+{
+    put(ROMDescriptor::Text, str, len);
+}
 
-        epicsUInt32 header = (info.type<<14) | contents.size()/2u;
+void ROMWriter::bigint(const std::string& hex)
+{
+    scratch.assign((hex.size()+1u)/2u, 0);
 
-        *reinterpret_cast<epicsUInt32*>(buf) = htonl(header);
-        buf += 4;
-        buflen -= 4;
+    for(size_t i=0; i<hex.size(); i++) {
+        unsigned val =unhexchar(hex[i]);
+        if((i%2u)==0)
+            val <<= 4;
+        scratch[i/2] |= val;
+    }
 
-        for(size_t i=0; i<contents.size(); i+=2)
-        {
-            buf[2*i+0] = buf[2*i+1] = 0;
-            buf[2*i+2] = contents[i+0];
-            buf[2*i+3] = contents[i+1];
-        }
+    put(ROMDescriptor::BigInt, scratch.empty() ? "" : &scratch[0], scratch.size());
+}
 
-        buf += contents.size()*2u;
-        buflen -= contents.size()*2u;
+void ROMWriter::json(const char *str, size_t len)
+{
+    Z.deflate(scratch, str, len);
+    put(ROMDescriptor::JSON, &scratch[0], scratch.size());
+}
 
-        assert(buf-orig+buflen == origlen);
+void ROMWriter::add(ROMDescriptor::type_t t, const std::string& value)
+{
+    switch(t) {
+    case ROMDescriptor::Invalid:
+        throw std::logic_error("ROM can't contain Invalid ROMDescriptor");
+    case ROMDescriptor::Text:
+        text(value.c_str(), value.size());
+        break;
+    case ROMDescriptor::BigInt:
+        bigint(value);
+        break;
+    case ROMDescriptor::JSON:
+        json(value.c_str(), value.size());
+        break;
     }
+}
 
+size_t ROMWriter::finish()
+{
     if(buflen<4) {
         throw std::runtime_error("Not enough space to add End Descriptor");
     }
+    memset(buf, 0, 4);
 
     return buf-orig;
 }
+
+size_t ROM::prepare(epicsUInt32* buf, size_t count)
+{
+    size_t ret = prepare(reinterpret_cast<char*>(buf), count*4u);
+    for(size_t i=0; i<count; i++) {
+        buf[i] = ntohl(buf[i]);
+    }
+    return ret/4u;
+}
+
+size_t ROM::prepare(char* buf, size_t buflen)
+{
+    ROMWriter W(buf, buflen);
+
+    for(infos_t::const_iterator it=infos.begin(), end=infos.end(); it!=end; ++it)
+    {
+        W.add(it->type, it->value);
+    }
+
+    return W.finish();
+}
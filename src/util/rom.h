@@ -3,10 +3,13 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include <epicsTypes.h>
 #include <shareLib.h>
 
+#include "zpp.h"
+
 struct ROMDescriptor
 {
     enum type_t {
@@ -24,6 +27,104 @@ struct ROMDescriptor
     {}
 };
 
+// Read-only view of a ROM image.
+// Descriptors are located in place, and decoded on request.
+// The image must out-live the view, and any iterators.
+struct epicsShareClass ROMView
+{
+    // A single descriptor within the image
+    struct epicsShareClass Entry
+    {
+        ROMDescriptor::type_t type;
+        const char *payload; // first payload word
+        size_t nbytes; // payload size, excluding unused upper bytes
+        bool swap;
+
+        Entry() :type(ROMDescriptor::Invalid), payload(0), nbytes(0u), swap(true) {}
+
+        // decode a single payload byte
+        char operator[](size_t i) const
+        {
+            const char *word = payload + 4u*(i/2u);
+            if(swap)
+                return word[2u + (i%2u)];
+            else
+                return word[1u - (i%2u)];
+        }
+
+        // copy out payload bytes.  output is replaced.
+        void copy(std::vector<char>& out) const;
+
+        // decode as ROM::parse() would.  output is replaced.
+        // JSON is inflated with a temporary ZInflater
+        void decode(std::string& out) const;
+
+        // inflate JSON payload.  output is replaced.
+        // scratch holds the compressed payload.  Both may be re-used between calls.
+        void inflate(std::vector<char>& out, std::vector<char>& scratch, ZInflater& Z) const;
+    };
+
+    class epicsShareClass const_iterator
+    {
+        const char *orig, *pos; // pos==NULL at end
+        size_t remaining;
+        Entry cur;
+        void next();
+    public:
+        const_iterator() :orig(0), pos(0), remaining(0u) {}
+        const_iterator(const char *buf, size_t buflen, bool swap);
+
+        const Entry& operator*() const { return cur; }
+        const Entry* operator->() const { return &cur; }
+
+        // throws std::runtime_error if image is malformed
+        const_iterator& operator++();
+
+        bool operator==(const const_iterator& o) const { return pos==o.pos; }
+        bool operator!=(const const_iterator& o) const { return pos!=o.pos; }
+    };
+
+    const char * const buf;
+    const size_t buflen;
+    const bool swap;
+
+    ROMView(const char* buf, size_t buflen, bool swap=true)
+        :buf(buf), buflen(buflen), swap(swap)
+    {}
+
+    // throws std::runtime_error if image is malformed
+    const_iterator begin() const { return const_iterator(buf, buflen, swap); }
+    const_iterator end() const { return const_iterator(); }
+};
+
+// Encode a ROM image directly into a buffer.
+// throws std::runtime_error on failure, including insufficient space
+struct epicsShareClass ROMWriter
+{
+    ROMWriter(char* buf, size_t buflen);
+
+    void text(const char *str, size_t len);
+    // hex string
+    void bigint(const std::string& hex);
+    // compressed with level 9
+    void json(const char *str, size_t len);
+    // dispatch by type
+    void add(ROMDescriptor::type_t t, const std::string& value);
+
+    // check for space for End Descriptor.
+    // returns number of bytes used (excluding End Descriptor)
+    size_t finish();
+
+private:
+    char * const orig;
+    char *buf;
+    size_t buflen;
+    std::vector<char> scratch;
+    ZDeflater Z;
+
+    void put(ROMDescriptor::type_t t, const char *payload, size_t len);
+};
+
 struct epicsShareClass ROM {
     typedef std::list<ROMDescriptor> infos_t;
     infos_t infos;
@@ -1,5 +1,6 @@
 
 #include <stdexcept>
+#include <algorithm>
 #include <string.h>
 
 #include <zlib.h>
@@ -7,94 +8,202 @@
 #include "utils.h"
 #include "zpp.h"
 
-void zdeflate(std::vector<char>& out, const char *in, size_t inlen, int lvl)
+namespace {
+// initial output size for inflate() when none is available for re-use.
+// grows x2 from here.
+size_t inflate_initial(size_t inlen)
+{
+    // text (JSON) typically compresses ~4:1
+    return std::max(size_t(256u), inlen*4u);
+}
+}
+
+struct ZDeflater::Pvt
 {
     z_stream strm;
-    memset(&strm, 0, sizeof(strm));
 
-    int err = deflateInit(&strm, lvl);
-    if(err!=Z_OK)
-        throw std::runtime_error(SB()<<"deflateInit() -> "<<err);
+    explicit Pvt(int lvl)
+    {
+        memset(&strm, 0, sizeof(strm));
 
-    try {
-        strm.next_in = (Bytef*)in;
-        strm.avail_in = inlen;
+        int err = deflateInit(&strm, lvl);
+        if(err!=Z_OK)
+            throw std::runtime_error(SB()<<"deflateInit() -> "<<err);
+    }
+    ~Pvt()
+    {
+        (void)deflateEnd(&strm);
+    }
 
-        while(true) {
-            // this number must be smaller than test data size
-            const size_t inc = 128;
+    void reset()
+    {
+        int err = deflateReset(&strm);
+        if(err!=Z_OK)
+            throw std::runtime_error(SB()<<"deflateReset() -> "<<err);
+    }
 
-            out.resize(strm.total_out+inc);
+    // returns true when complete
+    bool step()
+    {
+        int err = ::deflate(&strm, Z_FINISH);
+        if(err==Z_STREAM_END)
+            return true;
+        else if(err==Z_OK || (err==Z_BUF_ERROR && strm.avail_out==0))
+            return false; // need more output space
+        else if(strm.msg)
+            throw std::runtime_error(SB()<<"deflate() : "<<strm.msg);
+        else
+            throw std::runtime_error(SB()<<"deflate() -> "<<err);
+    }
+};
 
-            strm.next_out = (Bytef*)&out[strm.total_out];
-            strm.avail_out = inc;
+ZDeflater::ZDeflater(int lvl)
+    :pvt(new Pvt(lvl))
+{}
 
-            err = deflate(&strm, strm.avail_in ? Z_NO_FLUSH : Z_FINISH);
-            if(err==Z_STREAM_END)
-                break;
-            else if(err && strm.msg)
-                throw std::runtime_error(SB()<<"deflate() : "<<strm.msg);
-            else if(err)
-                throw std::runtime_error(SB()<<"deflate() -> "<<err);
-        }
+ZDeflater::~ZDeflater() {}
 
+size_t ZDeflater::bound(size_t inlen)
+{
+    return deflateBound(&pvt->strm, inlen);
+}
 
-        // hide unused
-        out.resize(out.size()-strm.avail_out);
+void ZDeflater::deflate(std::vector<char>& out, const char *in, size_t inlen)
+{
+    z_stream& strm = pvt->strm;
+    pvt->reset();
 
-        strm.avail_out = 0;
-    }catch(...){
-        deflateEnd(&strm);
-        throw;
+    strm.next_in = (Bytef*)in;
+    strm.avail_in = inlen;
+
+    // usually completes in one step
+    out.resize(std::max(out.capacity(), bound(inlen)));
+
+    while(true) {
+        strm.next_out = (Bytef*)&out[strm.total_out];
+        strm.avail_out = out.size() - strm.total_out;
+
+        if(pvt->step())
+            break;
+
+        out.resize(out.size()*2u);
     }
 
-    err = deflateEnd(&strm);
-    if(err!=Z_OK)
-        throw std::runtime_error(SB()<<"deflateEnd() -> "<<err);
+    // hide unused
+    out.resize(strm.total_out);
 }
 
-void zinflate(std::vector<char>& out, const char *in, size_t inlen)
+size_t ZDeflater::deflate(char *out, size_t outlen, const char *in, size_t inlen)
+{
+    z_stream& strm = pvt->strm;
+    pvt->reset();
+
+    strm.next_in = (Bytef*)in;
+    strm.avail_in = inlen;
+    strm.next_out = (Bytef*)out;
+    strm.avail_out = outlen;
+
+    if(!pvt->step())
+        throw std::runtime_error(SB()<<"deflate() output buffer too small "<<outlen);
+
+    return strm.total_out;
+}
+
+struct ZInflater::Pvt
 {
     z_stream strm;
-    memset(&strm, 0, sizeof(strm));
 
-    int err = inflateInit(&strm);
+    Pvt()
+    {
+        memset(&strm, 0, sizeof(strm));
 
-    if(err!=Z_OK)
-        throw std::runtime_error(SB()<<"inflateInit() -> "<<err);
+        int err = inflateInit(&strm);
+        if(err!=Z_OK)
+            throw std::runtime_error(SB()<<"inflateInit() -> "<<err);
+    }
+    ~Pvt()
+    {
+        (void)inflateEnd(&strm);
+    }
+
+    void reset()
+    {
+        int err = inflateReset(&strm);
+        if(err!=Z_OK)
+            throw std::runtime_error(SB()<<"inflateReset() -> "<<err);
+    }
 
-    try {
-        strm.next_in = (Bytef*)in;
-        strm.avail_in = inlen;
+    // returns true when complete
+    bool step()
+    {
+        int err = ::inflate(&strm, Z_NO_FLUSH);
+        if(err==Z_STREAM_END)
+            return true;
+        else if((err==Z_OK || err==Z_BUF_ERROR) && strm.avail_out==0)
+            return false; // need more output space
+        else if(err==Z_OK || err==Z_BUF_ERROR)
+            throw std::runtime_error("inflate() : truncated input");
+        else if(strm.msg)
+            throw std::runtime_error(SB()<<"inflate() : "<<strm.msg);
+        else
+            throw std::runtime_error(SB()<<"inflate() -> "<<err);
+    }
+};
 
-        while(true) {
-            // this number must be smaller than test data size
-            const size_t inc = 128;
+ZInflater::ZInflater()
+    :pvt(new Pvt)
+{}
 
-            out.resize(strm.total_out+inc);
+ZInflater::~ZInflater() {}
 
-            strm.next_out = (Bytef*)&out[strm.total_out];
-            strm.avail_out = inc;
+void ZInflater::inflate(std::vector<char>& out, const char *in, size_t inlen)
+{
+    z_stream& strm = pvt->strm;
+    pvt->reset();
 
-            err = inflate(&strm, strm.avail_in ? Z_NO_FLUSH : Z_FINISH);
-            if(err==Z_STREAM_END)
-                break;
-            else if(err && strm.msg)
-                throw std::runtime_error(SB()<<"inflate() : "<<strm.msg);
-            else if(err)
-                throw std::runtime_error(SB()<<"inflate() -> "<<err);
-        }
+    strm.next_in = (Bytef*)in;
+    strm.avail_in = inlen;
 
-        // hide unused
-        out.resize(out.size()-strm.avail_out);
+    out.resize(std::max(out.capacity(), inflate_initial(inlen)));
 
-        strm.avail_out = 0;
-    }catch(...){
-        inflateEnd(&strm);
-        throw;
+    while(true) {
+        strm.next_out = (Bytef*)&out[strm.total_out];
+        strm.avail_out = out.size() - strm.total_out;
+
+        if(pvt->step())
+            break;
+
+        out.resize(out.size()*2u);
     }
 
-    err = inflateEnd(&strm);
-    if(err!=Z_OK)
-        throw std::runtime_error(SB()<<"inflateEnd() -> "<<err);
+    // hide unused
+    out.resize(strm.total_out);
+}
+
+size_t ZInflater::inflate(char *out, size_t outlen, const char *in, size_t inlen)
+{
+    z_stream& strm = pvt->strm;
+    pvt->reset();
+
+    strm.next_in = (Bytef*)in;
+    strm.avail_in = inlen;
+    strm.next_out = (Bytef*)out;
+    strm.avail_out = outlen;
+
+    if(!pvt->step())
+        throw std::runtime_error(SB()<<"inflate() output buffer too small "<<outlen);
+
+    return strm.total_out;
+}
+
+void zdeflate(std::vector<char>& out, const char *in, size_t inlen, int lvl)
+{
+    ZDeflater Z(lvl);
+    Z.deflate(out, in, inlen);
+}
+
+void zinflate(std::vector<char>& out, const char *in, size_t inlen)
+{
+    ZInflater Z;
+    Z.inflate(out, in, inlen);
 }
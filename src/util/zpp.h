@@ -7,6 +7,8 @@
 
 #include <shareLib.h>
 
+#include "utils.h"
+
 // compress input and store in output.
 // existing contents of output are replaced
 epicsShareExtern void zdeflate(std::vector<char>& out, const char *in, size_t inlen, int lvl=6);
@@ -15,4 +17,48 @@ epicsShareExtern void zdeflate(std::vector<char>& out, const char *in, size_t in
 // existing contents of output are replaced
 epicsShareExtern void zinflate(std::vector<char>& out, const char *in, size_t inlen);
 
+// Re-usable compression context.
+// Keeps zlib state allocated between calls.
+class epicsShareClass ZDeflater
+{
+    struct Pvt;
+    feed::auto_ptr<Pvt> pvt;
+    ZDeflater(const ZDeflater&);
+    ZDeflater& operator=(const ZDeflater&);
+public:
+    explicit ZDeflater(int lvl=6);
+    ~ZDeflater();
+
+    // upper bound on compressed size of inlen bytes
+    size_t bound(size_t inlen);
+
+    // compress input and store in output.
+    // existing contents of output are replaced, existing capacity is re-used
+    void deflate(std::vector<char>& out, const char *in, size_t inlen);
+    // compress into caller provided buffer.  returns number of bytes stored.
+    // throws if outlen is too small.  outlen>=bound(inlen) is always enough.
+    size_t deflate(char *out, size_t outlen, const char *in, size_t inlen);
+};
+
+// Re-usable decompression context.
+// Keeps zlib state allocated between calls.
+class epicsShareClass ZInflater
+{
+    struct Pvt;
+    feed::auto_ptr<Pvt> pvt;
+    ZInflater(const ZInflater&);
+    ZInflater& operator=(const ZInflater&);
+public:
+    ZInflater();
+    ~ZInflater();
+
+    // uncompress input and store in output.
+    // existing contents of output are replaced, existing capacity is re-used.
+    // output grows geometrically.
+    void inflate(std::vector<char>& out, const char *in, size_t inlen);
+    // uncompress into caller provided buffer.  returns number of bytes stored.
+    // throws if outlen is too small.
+    size_t inflate(char *out, size_t outlen, const char *in, size_t inlen);
+};
+
 #endif // ZPP_H
@@ -0,0 +1,539 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include <string.h>
+#include <stdio.h>
+
+#ifdef __linux__
+#  include <dirent.h>
+#  include <unistd.h>
+#endif
+
+#include <epicsGetopt.h>
+#include <epicsStdlib.h>
+#include <epicsStdio.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsExit.h>
+#include <callback.h>
+
+#include <device.h>
+#include <rom.h>
+#include <simulator.h>
+
+/* End-to-end benchmark of Device against an in-process Simulator.
+ *
+ * Runs each combination of the parameter lists, and prints one JSON
+ * object per line with the results.  eg.
+ *
+ *   ./benchdevice -s 1,8192 -w 1,8 -n 1,16 -l 0,0.01 -L $(git describe --always) >> bench.jsonl
+ */
+
+namespace {
+
+void usage(const char* exe)
+{
+    std::cout<<"Usage: "<<exe<<" [-h] [-s <words>,...] [-w <inflight>,...] [-n <records>,...] [-r <Hz>,...]\n"
+               "         [-l <loss>,...] [-m read|write,...] [-T <sec>] [-t <sec>] [-L <label>] [-o <file>]\n"
+               "\n"
+               " -s  Register sizes in 32-bit words.  Rounded up to a power of 2.  Default 1,1024,65536\n"
+               " -w  feedNumInFlight.  Default 1,4\n"
+               " -n  Number of records, each with a separate register.  Default 1,16\n"
+               " -r  Per-record scan rate.  0 re-queues on completion.  Default 0\n"
+               " -l  Probability that a Simulator reply is dropped.  Default 0\n"
+               " -m  Operations.  Default read,write\n"
+               " -T  Duration of each case.  Default 2.0\n"
+               " -t  feedTimeout.  Default 0.1\n"
+               " -L  Label added to each result.  eg. a commit hash\n"
+               " -o  Append results to file instead of stdout\n";
+}
+
+template<typename T>
+void parse_list(const char *arg, std::vector<T>& out, T (*conv)(const std::string&))
+{
+    out.clear();
+    std::string s(arg);
+    size_t start = 0u;
+    while(true) {
+        size_t end = s.find(',', start);
+        out.push_back(conv(s.substr(start, end==s.npos ? s.npos : end-start)));
+        if(end==s.npos)
+            break;
+        start = end+1;
+    }
+}
+
+epicsUInt32 conv_uint(const std::string& s)
+{
+    epicsUInt32 ret;
+    if(epicsParseUInt32(s.c_str(), &ret, 0, 0))
+        throw std::runtime_error(SB()<<"Invalid integer '"<<s<<"'");
+    return ret;
+}
+
+double conv_double(const std::string& s)
+{
+    double ret;
+    if(epicsParseDouble(s.c_str(), &ret, 0))
+        throw std::runtime_error(SB()<<"Invalid number '"<<s<<"'");
+    return ret;
+}
+
+std::string conv_mode(const std::string& s)
+{
+    if(s!="read" && s!="write")
+        throw std::runtime_error(SB()<<"Invalid mode '"<<s<<"'");
+    return s;
+}
+
+// Sum of user+system CPU time of all threads whose name begins with 'prefix'.
+// Returns -1 where not supported.
+double thread_cpu(const char *prefix, const char *exclude=0)
+{
+#ifdef __linux__
+    DIR *dir = opendir("/proc/self/task");
+    if(!dir)
+        return -1.0;
+
+    double total = 0.0;
+    const double tick = sysconf(_SC_CLK_TCK);
+
+    while(dirent *ent = readdir(dir)) {
+        if(ent->d_name[0]=='.')
+            continue;
+
+        std::string base(SB()<<"/proc/self/task/"<<ent->d_name<<"/"), comm, stat;
+        try {
+            comm = read_entire_file((base+"comm").c_str());
+            stat = read_entire_file((base+"stat").c_str());
+        }catch(std::runtime_error&){
+            continue; // thread exited
+        }
+        if(comm.compare(0, strlen(prefix), prefix)!=0)
+            continue;
+        if(exclude && comm.compare(0, strlen(exclude), exclude)==0)
+            continue;
+
+        // skip past "<pid> (<comm>)" as comm may contain spaces
+        size_t paren = stat.rfind(')');
+        if(paren==stat.npos)
+            continue;
+        std::istringstream strm(stat.substr(paren+1));
+
+        // fields 3 through 13 precede utime and stime
+        std::string skip;
+        for(unsigned i=3; i<=13; i++)
+            strm>>skip;
+        unsigned long utime=0, stime=0;
+        strm>>utime>>stime;
+
+        total += (utime+stime)/tick;
+    }
+    closedir(dir);
+    return total;
+#else
+    (void)prefix;
+    (void)exclude;
+    return -1.0;
+#endif
+}
+
+struct Case {
+    epicsUInt32 size, inflight, nrecords;
+    double rate, loss;
+    std::string mode;
+};
+
+struct Result {
+    size_t ops, errors, overruns;
+    double duration, reconnect, worker_cpu, sim_cpu;
+    epicsUInt32 packets, timeouts;
+    std::vector<double> latency; // seconds
+    Result() :ops(0u), errors(0u), overruns(0u), duration(0.0), reconnect(0.0), worker_cpu(0.0), sim_cpu(0.0), packets(0u), timeouts(0u) {}
+};
+
+struct Client final : public RegInterest
+{
+    Result& result;
+    bool write, requeue, busy, stop;
+    epicsTime queued;
+
+    Client(Device *dev, DevReg *reg, Result& result, bool write, bool requeue)
+        :RegInterest(0, dev)
+        ,result(result)
+        ,write(write)
+        ,requeue(requeue)
+        ,busy(false)
+        ,stop(true)
+    {
+        this->reg = reg;
+    }
+    virtual ~Client() {}
+
+    // call with device lock held
+    void start()
+    {
+        queued = epicsTime::getCurrent();
+        busy = true;
+        reg->queue(write, this);
+    }
+
+    // called from Device worker, unlocked
+    virtual void complete() override final
+    {
+        const epicsTime now(epicsTime::getCurrent());
+
+        Guard G(device->lock);
+        busy = false;
+        if(reg->sevr) {
+            result.errors++;
+        } else {
+            result.ops++;
+            result.latency.push_back(now-queued);
+        }
+        // after a timeout, wait for reconnect.  main loop will re-queue
+        if(requeue && !stop && device->current==Device::Running)
+            start();
+    }
+};
+
+struct SimRunner : public epicsThreadRunable {
+    feed::auto_ptr<Simulator> instance;
+    epicsThread runner;
+    osiSockAddr endpoint;
+
+    SimRunner(const std::string& json)
+        :runner(*this, "FEEDSIM",
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                epicsThreadPriorityMedium)
+    {
+        memset(&endpoint, 0, sizeof(endpoint));
+        endpoint.ia.sin_family = AF_INET;
+        endpoint.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        endpoint.ia.sin_port = htons(0);
+
+        JBlob blob;
+        Simulator::values_t initial;
+        blob.parse(json.c_str());
+
+        ROM rom;
+        rom.push_back(ROMDescriptor::Text, "FEED Benchmark");
+        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
+        rom.push_back(ROMDescriptor::BigInt, "0000000000000000000000000000000000000000");
+        rom.push_back(ROMDescriptor::JSON, json);
+
+        instance.reset(new Simulator(endpoint, blob, initial));
+        instance->debug = false;
+
+        SimReg& reg = (*instance)["ROM"];
+        rom.prepare(&reg.storage[0], reg.storage.size());
+
+        instance->endpoint(endpoint);
+    }
+
+    ~SimRunner()
+    {
+        instance->interrupt();
+        runner.exitWait();
+    }
+
+    virtual void run() override final
+    {
+        instance->exec();
+    }
+};
+
+epicsUInt32 round_pow2(epicsUInt32 size, unsigned& width)
+{
+    width = 0u;
+    while((1u<<width) < size)
+        width++;
+    return 1u<<width;
+}
+
+// one register per record, placed above the ROM
+std::string make_json(epicsUInt32 size, epicsUInt32 nrecords)
+{
+    unsigned width;
+    size = round_pow2(size, width);
+    const epicsUInt32 base = std::max(size, 0x10000u);
+
+    if(epicsUInt64(base) + epicsUInt64(size)*nrecords > 0x1000000u)
+        throw std::runtime_error(SB()<<nrecords<<" registers of "<<size<<" words exceed 24-bit address space");
+
+    std::ostringstream strm;
+    strm<<"{";
+    for(epicsUInt32 i=0; i<nrecords; i++) {
+        strm<<(i ? ",\n" : "\n")
+            <<"\"bench"<<i<<"\": {\"access\": \"rw\", \"addr_width\": "<<width
+            <<", \"base_addr\": "<<(base+i*size)<<", \"data_width\": 32, \"sign\": \"unsigned\"}";
+    }
+    strm<<"\n}\n";
+    return strm.str();
+}
+
+double percentile(std::vector<double>& vals, double frac)
+{
+    if(vals.empty())
+        return 0.0;
+    size_t idx = std::min(vals.size()-1u, size_t(frac*vals.size()));
+    std::nth_element(vals.begin(), vals.begin()+idx, vals.end());
+    return vals[idx];
+}
+
+void run_case(const Case& bcase, double duration, Result& result)
+{
+    static unsigned ndevices;
+
+    SimRunner sim(make_json(bcase.size, bcase.nrecords));
+    sim.instance->impair.drop = bcase.loss;
+    sim.runner.start();
+
+    // consulted by Device ctor.  Devices are never free'd
+    feedNumInFlight = bcase.inflight;
+    osiSockAddr iface;
+    memset(&iface, 0, sizeof(iface));
+    iface.ia.sin_family = AF_INET;
+    iface.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Device *dev = new Device(SB()<<"bench"<<ndevices++, iface);
+
+    std::vector<Client*> clients;
+    const bool write = bcase.mode=="write";
+    const bool requeue = bcase.rate<=0.0;
+
+    const epicsTime start(epicsTime::getCurrent());
+    {
+        Guard G(dev->lock);
+        dev->debug = 0u;
+        dev->peer_name = PrintAddr(sim.endpoint).c_str();
+        dev->peer_addr = sim.endpoint;
+        dev->request_reset();
+    }
+    dev->runner.start();
+
+    Guard G(dev->lock);
+
+    // losses may delay connection
+    for(double remaining = 10.0 + 100*feedTimeout; dev->current!=Device::Running && remaining>0.0; remaining-=0.001)
+    {
+        UnGuard U(G);
+        epicsThreadSleep(0.001);
+    }
+    if(dev->current!=Device::Running)
+        throw std::runtime_error(SB()<<"Unable to connect to simulator : "<<dev->last_message);
+
+    result.reconnect = epicsTime::getCurrent()-start;
+
+    for(epicsUInt32 i=0; i<bcase.nrecords; i++) {
+        Device::reg_by_name_t::const_iterator it(dev->reg_by_name.find(SB()<<"bench"<<i));
+        if(it==dev->reg_by_name.end())
+            throw std::runtime_error("Missing register");
+        clients.push_back(new Client(dev, it->second, result, write, requeue));
+    }
+
+    // warm up with one operation per record (stop is set), then measure
+    for(size_t i=0; i<clients.size(); i++)
+        clients[i]->start();
+    for(bool busy=true; busy; ) {
+        busy = false;
+        for(size_t i=0; i<clients.size(); i++)
+            busy |= clients[i]->busy;
+        UnGuard U(G);
+        epicsThreadSleep(0.001);
+    }
+
+    result.ops = result.errors = 0u;
+    result.latency.clear();
+    const epicsUInt32 sent0 = dev->cnt_sent, timo0 = dev->cnt_timo;
+    double worker0, sim0;
+    {
+        UnGuard U(G);
+        worker0 = thread_cpu("FEED", "FEEDSIM");
+        sim0 = thread_cpu("FEEDSIM");
+    }
+    const epicsTime begin(epicsTime::getCurrent());
+
+    for(size_t i=0; i<clients.size(); i++)
+        clients[i]->stop = false;
+
+    if(requeue) {
+        while(epicsTime::getCurrent()-begin < duration) {
+            for(size_t i=0; i<clients.size(); i++) {
+                if(!clients[i]->busy && dev->current==Device::Running)
+                    clients[i]->start();
+            }
+            UnGuard U(G);
+            epicsThreadSleep(0.001);
+        }
+
+    } else {
+        const double period = 1.0/bcase.rate;
+        for(double next = 0.0; next < duration; next += period) {
+            for(size_t i=0; i<clients.size(); i++) {
+                if(clients[i]->busy)
+                    result.overruns++;
+                else
+                    clients[i]->start();
+            }
+            double wait = next + period - (epicsTime::getCurrent()-begin);
+            if(wait>0.0) {
+                UnGuard U(G);
+                epicsThreadSleep(wait);
+            }
+        }
+    }
+
+    result.duration = epicsTime::getCurrent()-begin;
+    result.packets = dev->cnt_sent - sent0;
+    result.timeouts = dev->cnt_timo - timo0;
+    {
+        UnGuard U(G);
+        result.worker_cpu = thread_cpu("FEED", "FEEDSIM");
+        result.sim_cpu = thread_cpu("FEEDSIM");
+    }
+    if(result.worker_cpu>=0.0) {
+        result.worker_cpu -= worker0;
+        result.sim_cpu -= sim0;
+    }
+
+    // drain, then leave this Device idle
+    for(size_t i=0; i<clients.size(); i++)
+        clients[i]->stop = true;
+    for(double remaining = 10.0; remaining>0.0; remaining-=0.001) {
+        bool busy = false;
+        for(size_t i=0; i<clients.size(); i++)
+            busy |= clients[i]->busy;
+        if(!busy)
+            break;
+        UnGuard U(G);
+        epicsThreadSleep(0.001);
+    }
+
+    dev->peer_name.clear();
+    dev->request_reset();
+    {
+        UnGuard U(G);
+        // wait for the reset to complete any outstanding operations
+        epicsThreadSleep(2*feedTimeout);
+    }
+    // RegInterest pointers may linger in (now reset) registers, so never free'd
+}
+
+void print_result(std::ostream& out, const std::string& label, const Case& bcase, Result& result)
+{
+    unsigned width;
+    const epicsUInt32 words = round_pow2(bcase.size, width);
+    const double secs = result.duration>0.0 ? result.duration : 1.0;
+
+    out<<"{\"label\":\""<<label<<"\""
+       <<",\"size\":"<<words
+       <<",\"inflight\":"<<bcase.inflight
+       <<",\"nrecords\":"<<bcase.nrecords
+       <<",\"rate\":"<<bcase.rate
+       <<",\"loss\":"<<bcase.loss
+       <<",\"mode\":\""<<bcase.mode<<"\""
+       <<",\"duration\":"<<result.duration
+       <<",\"ops\":"<<result.ops
+       <<",\"errors\":"<<result.errors
+       <<",\"overruns\":"<<result.overruns
+       <<",\"ops_per_sec\":"<<(result.ops/secs)
+       <<",\"MB_per_sec\":"<<(result.ops*4.0*words/secs/1e6)
+       <<",\"lat_p50_us\":"<<(percentile(result.latency, 0.50)*1e6)
+       <<",\"lat_p99_us\":"<<(percentile(result.latency, 0.99)*1e6)
+       <<",\"lat_max_us\":"<<(percentile(result.latency, 1.0)*1e6)
+       <<",\"reconnect_sec\":"<<result.reconnect
+       <<",\"packets\":"<<result.packets
+       <<",\"timeouts\":"<<result.timeouts
+       <<",\"worker_cpu_sec\":"<<result.worker_cpu
+       <<",\"worker_cpu_us_per_packet\":"<<(result.packets && result.worker_cpu>=0.0 ? result.worker_cpu*1e6/result.packets : -1.0)
+       <<",\"sim_cpu_sec\":"<<result.sim_cpu
+       <<"}\n";
+    out.flush();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    try {
+        int opt;
+        std::vector<epicsUInt32> sizes, inflights, nrecords;
+        std::vector<double> rates, losses;
+        std::vector<std::string> modes;
+        double duration = 2.0;
+        const char *outname = 0;
+        std::string label;
+
+        parse_list("1,1024,65536", sizes, conv_uint);
+        parse_list("1,4", inflights, conv_uint);
+        parse_list("1,16", nrecords, conv_uint);
+        parse_list("0", rates, conv_double);
+        parse_list("0", losses, conv_double);
+        parse_list("read,write", modes, conv_mode);
+        feedTimeout = 0.1;
+
+        while((opt=getopt(argc, argv, "hs:w:n:r:l:m:T:t:L:o:"))!=-1) {
+            switch(opt) {
+            case 's': parse_list(optarg, sizes, conv_uint); break;
+            case 'w': parse_list(optarg, inflights, conv_uint); break;
+            case 'n': parse_list(optarg, nrecords, conv_uint); break;
+            case 'r': parse_list(optarg, rates, conv_double); break;
+            case 'l': parse_list(optarg, losses, conv_double); break;
+            case 'm': parse_list(optarg, modes, conv_mode); break;
+            case 'T': duration = conv_double(optarg); break;
+            case 't': feedTimeout = conv_double(optarg); break;
+            case 'L': label = optarg; break;
+            case 'o': outname = optarg; break;
+            default:
+                std::cerr<<"Unknown option '"<<opt<<"'\n\n";
+                // fall through
+            case 'h':
+                usage(argv[0]);
+                return 2;
+            }
+        }
+
+        std::ofstream outfile;
+        if(outname) {
+            outfile.open(outname, std::ios::out|std::ios::app);
+            if(!outfile.is_open())
+                throw std::runtime_error(SB()<<"Failed to open "<<outname);
+        }
+        std::ostream& out = outname ? outfile : std::cout;
+
+        // BlobJob is queued to a callback thread
+        callbackInit();
+
+        Case bcase;
+        for(size_t s=0; s<sizes.size(); s++)
+        for(size_t w=0; w<inflights.size(); w++)
+        for(size_t n=0; n<nrecords.size(); n++)
+        for(size_t r=0; r<rates.size(); r++)
+        for(size_t l=0; l<losses.size(); l++)
+        for(size_t m=0; m<modes.size(); m++)
+        {
+            bcase.size = std::max(1u, sizes[s]);
+            bcase.inflight = inflights[w];
+            bcase.nrecords = std::max(1u, nrecords[n]);
+            bcase.rate = rates[r];
+            bcase.loss = losses[l];
+            bcase.mode = modes[m];
+
+            Result result;
+            run_case(bcase, duration, result);
+            print_result(out, label, bcase, result);
+        }
+
+        epicsExit(0); // stops Device workers
+        return 0;
+    }catch(std::exception& e){
+        std::cerr<<"Error: "<<e.what()<<"\n";
+        epicsExit(1);
+        return 1;
+    }
+}
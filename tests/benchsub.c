@@ -0,0 +1,373 @@
+/* Micro-benchmark of the rf aSub functions.
+ *
+ * Calls each registered function directly on an aSubRecord from benchsub.db,
+ * with inputs filled with synthetic data, bypassing link I/O.
+ * Prints one JSON object per kernel and size with ns/element.  eg.
+ *
+ *   ./benchsub -n 1024,65536 -L $(git describe --always) >> benchsub.jsonl
+ *
+ * In C as aSubRecord.h has a field named 'not'.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <epicsGetopt.h>
+#include <epicsStdlib.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <dbDefs.h>
+#include <dbUnitTest.h>
+#include <dbAccess.h>
+#include <dbLock.h>
+#include <iocInit.h>
+#include <registryFunction.h>
+#include <aSubRecord.h>
+
+#define PI 3.14159265359
+#define MAXELEM 65536u
+#define MAXSIZES 16
+
+void testfeed_registerRecordDeviceDriver(struct dbBase *);
+
+typedef long (*asub_fn)(aSubRecord*);
+
+static
+void usage(const char* exe)
+{
+    printf("Usage: %s [-h] [-n <nelem>,...] [-k <kernel>] [-T <sec>] [-L <label>] [-o <file>]\n"
+           "\n"
+           " -n  Number of elements.  Max 65536.  Default 1024,4096,16384,65536\n"
+           " -k  Only run the named kernel.  eg. \"Wf Stats\"\n"
+           " -T  Minimum time for each measurement.  Default 0.2\n"
+           " -L  Label added to each result.  eg. a commit hash\n"
+           " -o  Append results to file instead of stdout\n", exe);
+}
+
+/* deterministic fill in [lo, hi) */
+static
+void fill(void *raw, epicsUInt32 N, double lo, double hi, unsigned seed)
+{
+    double *arr = (double*)raw;
+    epicsUInt32 state = 2463534242u ^ seed;
+    epicsUInt32 i;
+    for(i=0; i<N; i++) {
+        state ^= state<<13;
+        state ^= state>>17;
+        state ^= state<<5;
+        arr[i] = lo + (hi-lo)*(state/4294967296.0);
+    }
+}
+
+static
+void scalar(void *raw, double val)
+{
+    *(double*)raw = val;
+}
+
+static
+void setup_iq2ap(aSubRecord *prec, epicsUInt32 N)
+{
+    fill(prec->a, N, -1.0, 1.0, 1);
+    fill(prec->b, N, -1.0, 1.0, 2);
+    scalar(prec->c, 1.0);  /* power scale */
+    scalar(prec->d, 0.0);  /* zero angle */
+    scalar(prec->e, 10.0); /* display rotation */
+    scalar(prec->f, 0.0);  /* no dBm */
+    prec->nea = prec->neb = N;
+}
+
+static
+void setup_ap2iq(aSubRecord *prec, epicsUInt32 N)
+{
+    fill(prec->a, N, 0.0, 1.0, 1);
+    fill(prec->b, N, -180.0, 180.0, 2);
+    prec->nea = prec->neb = N;
+}
+
+static
+void setup_wfstats(aSubRecord *prec, epicsUInt32 N)
+{
+    double *time = (double*)prec->b;
+    epicsUInt32 i;
+    fill(prec->a, N, -1.0, 1.0, 1);
+    for(i=0; i<N; i++)
+        time[i] = i;
+    /* middle half */
+    scalar(prec->c, N/4);
+    scalar(prec->d, N/2);
+    *(epicsInt32*)prec->e = 0;
+    prec->nea = prec->neb = N;
+}
+
+static
+void setup_wfstatsmulti(aSubRecord *prec, epicsUInt32 N)
+{
+    double *time = (double*)prec->b,
+           *start = (double*)prec->c,
+           *width = (double*)prec->d;
+    epicsUInt32 i;
+    fill(prec->a, N, -1.0, 1.0, 1);
+    for(i=0; i<N; i++)
+        time[i] = i;
+    /* 16 overlapping windows, each a quarter */
+    for(i=0; i<16u; i++) {
+        start[i] = i*(N/20u);
+        width[i] = N/4u;
+    }
+    *(epicsInt32*)prec->e = 0;
+    prec->nea = prec->neb = N;
+    prec->nec = prec->ned = 16u;
+}
+
+static
+void setup_iq2apstats(aSubRecord *prec, epicsUInt32 N)
+{
+    double *time = (double*)prec->g;
+    epicsUInt32 i;
+    fill(prec->a, N, -1.0, 1.0, 1);
+    fill(prec->b, N, -1.0, 1.0, 2);
+    scalar(prec->c, 1.0);  /* power scale */
+    scalar(prec->d, 0.0);  /* zero angle */
+    scalar(prec->e, 0.0);  /* no dBm */
+    scalar(prec->f, 0.0);  /* exact */
+    for(i=0; i<N; i++)
+        time[i] = i;
+    /* middle half */
+    scalar(prec->h, N/4);
+    scalar(prec->i, N/2);
+    prec->nea = prec->neb = prec->neg = N;
+}
+
+static
+void setup_unwrap(aSubRecord *prec, epicsUInt32 N)
+{
+    double *pha = (double*)prec->a;
+    epicsUInt32 i;
+    for(i=0; i<N; i++) {
+        double p = fmod(i*7.3, 360.0);
+        pha[i] = p>=180.0 ? p-360.0 : p;
+    }
+    scalar(prec->b, 20.0);
+    prec->nea = N;
+}
+
+static
+void setup_ctrl(aSubRecord *prec, epicsUInt32 N)
+{
+    scalar(prec->a, 10.0); /* phase offset */
+    fill(prec->b, N, -1.0, 1.0, 1);
+    fill(prec->c, N, -1.0, 1.0, 2);
+    fill(prec->d, N, -180.0, 180.0, 3);
+    scalar(prec->e, 1.0);  /* gain */
+    scalar(prec->f, 0.0);  /* exact */
+    prec->neb = prec->nec = prec->ned = N;
+}
+
+static
+void setup_detune(aSubRecord *prec, epicsUInt32 N)
+{
+    fill(prec->a, N, 0.5, 1.0, 1);
+    fill(prec->b, N, 0.5, 1.0, 2);
+    fill(prec->c, N, -1.0, 1.0, 3);
+    fill(prec->d, N, -1.0, 1.0, 4);
+    scalar(prec->e, 100.0); /* bcoef magnitude */
+    scalar(prec->f, 30.0);  /* bcoef phase */
+    scalar(prec->g, 1.0);
+    scalar(prec->h, 1.0);
+    scalar(prec->i, 1e-6);  /* sample period */
+    prec->nea = prec->neb = prec->nec = prec->ned = N;
+}
+
+static
+void setup_faultunwrap(aSubRecord *prec, epicsUInt32 N)
+{
+    fill(prec->a, N, -1.0, 1.0, 1);
+    fill(prec->d, N, -1.0, 1.0, 2);
+    *(epicsUInt16*)prec->b = (epicsUInt16)(N/3);
+    *(epicsUInt16*)prec->c = 1;
+    prec->nea = prec->ned = N;
+}
+
+static
+void setup_wggen(aSubRecord *prec, epicsUInt32 N)
+{
+    strcpy((char*)prec->a, "B*sin(C)");
+    fill(prec->b, N, -1.0, 1.0, 1);
+    fill(prec->c, N, -PI, PI, 2);
+    prec->nea = 1;
+    prec->neb = prec->nec = N;
+}
+
+typedef struct {
+    const char *name, *record;
+    void (*setup)(aSubRecord*, epicsUInt32);
+    epicsUInt32 maxelem;
+} kernel;
+
+static const kernel kernels[] = {
+    {"IQ2AP", "iq2ap", &setup_iq2ap, MAXELEM},
+    {"AP2IQ", "ap2iq", &setup_ap2iq, MAXELEM},
+    {"Wf Stats", "wfstats", &setup_wfstats, MAXELEM},
+    {"Wf Stats Multi", "wfstatsmulti", &setup_wfstatsmulti, MAXELEM},
+    {"IQ2AP Stats", "iq2apstats", &setup_iq2apstats, MAXELEM},
+    {"Phase Unwrap", "unwrap", &setup_unwrap, MAXELEM},
+    {"Controller Output", "ctrl", &setup_ctrl, MAXELEM},
+    {"Calculate Detune", "detune", &setup_detune, MAXELEM},
+    /* uses 16-bit index */
+    {"Fault Unwrap", "faultunwrap", &setup_faultunwrap, MAXELEM-1u},
+    {"WG Gen", "wggen", &setup_wggen, MAXELEM},
+};
+
+/* comma separated list.  returns number of entries, or 0 on error */
+static
+size_t parse_sizes(char *arg, epicsUInt32 *sizes)
+{
+    size_t n;
+    char *tok;
+    for(n=0u; (tok = strtok(arg, ","))!=NULL; arg = NULL, n++) {
+        if(n==MAXSIZES)
+            return 0u;
+        if(epicsParseUInt32(tok, &sizes[n], 0, NULL) || sizes[n]<3u || sizes[n]>MAXELEM)
+            return 0u;
+    }
+    return n;
+}
+
+/* returns seconds per call, or negative on error */
+static
+double measure(asub_fn fn, aSubRecord *prec, double mintime, size_t *iters)
+{
+    double elapsed = 0.0;
+    size_t n = 1u, i;
+
+    *iters = 0u;
+
+    dbScanLock((dbCommon*)prec);
+
+    /* warm up, and check */
+    if(fn(prec)!=0 || prec->nsev) {
+        dbScanUnlock((dbCommon*)prec);
+        return -1.0;
+    }
+
+    while(elapsed < mintime) {
+        epicsTimeStamp start, end;
+
+        epicsTimeGetCurrent(&start);
+        for(i=0; i<n; i++)
+            (void)fn(prec);
+        epicsTimeGetCurrent(&end);
+
+        elapsed += epicsTimeDiffInSeconds(&end, &start);
+        *iters += n;
+        n *= 2u;
+    }
+
+    dbScanUnlock((dbCommon*)prec);
+    return elapsed / *iters;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    epicsUInt32 sizes[MAXSIZES] = {1024, 4096, 16384, 65536};
+    size_t nsizes = 4u, k, s;
+    double mintime = 0.2;
+    const char *only = NULL, *label = "";
+    FILE *out = stdout;
+
+    while((opt=getopt(argc, argv, "hn:k:T:L:o:"))!=-1) {
+        switch(opt) {
+        case 'n':
+            nsizes = parse_sizes(optarg, sizes);
+            if(nsizes==0u) {
+                fprintf(stderr, "-n values must be in [3, %u]\n", MAXELEM);
+                return 2;
+            }
+            break;
+        case 'k':
+            only = optarg;
+            break;
+        case 'T':
+            if(epicsParseDouble(optarg, &mintime, NULL)) {
+                fprintf(stderr, "-T value must be a number\n");
+                return 2;
+            }
+            break;
+        case 'L':
+            label = optarg;
+            break;
+        case 'o':
+            out = fopen(optarg, "a");
+            if(!out) {
+                fprintf(stderr, "Failed to open %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Unknown option '%c'\n\n", opt);
+            /* fall through */
+        case 'h':
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    testdbPrepare();
+
+    testdbReadDatabase("testfeed.dbd", 0, 0);
+    testfeed_registerRecordDeviceDriver(pdbbase);
+
+    testdbReadDatabase("benchsub.db", ".:..:", "N=65536");
+
+    eltc(0);
+    if(iocBuildIsolated() || iocRun()) {
+        fprintf(stderr, "iocInit fails\n");
+        return 1;
+    }
+    eltc(1);
+
+    for(k=0; k<NELEMENTS(kernels); k++) {
+        const kernel *kern = &kernels[k];
+        asub_fn fn = (asub_fn)registryFunctionFind(kern->name);
+        aSubRecord *prec = (aSubRecord*)testdbRecordPtr(kern->record);
+
+        if(only && strcmp(only, kern->name)!=0)
+            continue;
+
+        if(!fn) {
+            fprintf(stderr, "No function %s\n", kern->name);
+            return 1;
+        }
+
+        for(s=0; s<nsizes; s++) {
+            epicsUInt32 N = sizes[s] < kern->maxelem ? sizes[s] : kern->maxelem;
+            size_t iters;
+            double percall;
+
+            kern->setup(prec, N);
+
+            percall = measure(fn, prec, mintime, &iters);
+            if(percall < 0.0) {
+                fprintf(stderr, "%s fails with %u elements\n", kern->name, (unsigned)N);
+                return 1;
+            }
+
+            fprintf(out, "{\"label\":\"%s\",\"kernel\":\"%s\",\"nelem\":%u,\"iterations\":%lu"
+                         ",\"ns_per_call\":%.1f,\"ns_per_elem\":%.3f}\n",
+                    label, kern->name, (unsigned)N, (unsigned long)iters,
+                    percall*1e9, percall*1e9/N);
+            fflush(out);
+        }
+    }
+
+    iocShutdown();
+    testdbCleanup();
+    errlogFlush();
+
+    if(out!=stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdexcept>
+#include <vector>
+
+#include <errlog.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "addrindex.h"
+
+namespace {
+
+typedef AddrIndex<int> index_t;
+
+int lookup(const index_t& idx, epicsUInt32 addr)
+{
+    const index_t::Range *range = idx.find(addr);
+    return range ? range->value : -1;
+}
+
+void testLookup()
+{
+    testDiag("testLookup()");
+
+    index_t idx;
+
+    testOk1(lookup(idx, 0)==-1);
+
+    testOk1(idx.insert(0x0000, 4, 1)==0u);
+    testOk1(idx.insert(0x4000, 0x4000, 3)==0u);
+    testOk1(idx.insert(0x0800, 0x800, 2)==0u);
+    testOk1(idx.insert(0x0020, 0, 9)==0u); // empty, ignored
+    testOk1(idx.size()==3u);
+
+    testOk1(lookup(idx, 0x0000)==1);
+    testOk1(lookup(idx, 0x0003)==1);
+    testOk1(lookup(idx, 0x0004)==-1);
+    testOk1(lookup(idx, 0x0020)==-1);
+    testOk1(lookup(idx, 0x07ff)==-1);
+    testOk1(lookup(idx, 0x0800)==2);
+    testOk1(lookup(idx, 0x0fff)==2);
+    testOk1(lookup(idx, 0x1000)==-1);
+    testOk1(lookup(idx, 0x4000)==3);
+    testOk1(lookup(idx, 0x7fff)==3);
+    testOk1(lookup(idx, 0x8000)==-1);
+    testOk1(lookup(idx, 0xffffffff)==-1);
+
+    // ends at the last possible address
+    testOk1(idx.insert(0xfffffff0, 0x10, 4)==0u);
+    testOk1(lookup(idx, 0xffffffff)==4);
+}
+
+void testOverlap()
+{
+    testDiag("testOverlap()");
+
+    index_t idx;
+    std::vector<int> displaced;
+
+    idx.insert(0x100, 0x100, 1);
+
+    // split in the middle
+    testOk1(idx.insert(0x140, 0x10, 2, &displaced)==0x10u);
+    testOk1(displaced.size()==1u && displaced[0]==1);
+    testOk1(idx.size()==3u);
+    testOk1(lookup(idx, 0x13f)==1);
+    testOk1(lookup(idx, 0x140)==2);
+    testOk1(lookup(idx, 0x14f)==2);
+    testOk1(lookup(idx, 0x150)==1);
+    testOk1(lookup(idx, 0x1ff)==1);
+
+    // cover several
+    displaced.clear();
+    testOk1(idx.insert(0x0f0, 0x160, 3, &displaced)==0x100u);
+    testOk1(displaced.size()==3u);
+    testOk1(idx.size()==1u);
+    testOk1(lookup(idx, 0x0ef)==-1);
+    testOk1(lookup(idx, 0x0f0)==3);
+    testOk1(lookup(idx, 0x24f)==3);
+    testOk1(lookup(idx, 0x250)==-1);
+
+    // trim the upper end
+    testOk1(idx.insert(0x200, 0x100, 4)==0x50u);
+    testOk1(lookup(idx, 0x1ff)==3);
+    testOk1(lookup(idx, 0x200)==4);
+    testOk1(idx.size()==2u);
+
+    // ranges stay sorted
+    epicsUInt32 prev = 0u;
+    bool sorted = true;
+    for(index_t::const_iterator it(idx.begin()), end(idx.end()); it!=end; ++it) {
+        sorted &= it->base >= prev && it->end > it->base;
+        prev = epicsUInt32(it->end);
+    }
+    testOk1(sorted);
+}
+
+} // namespace
+
+MAIN(testaddr)
+{
+    testPlan(0);
+    try {
+        testLookup();
+        testOverlap();
+
+        errlogFlush();
+    }catch(std::exception& e){
+        testAbort("Uncaught exception: %s", e.what());
+    }
+    return testDone();
+}
@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <string.h>
 
+#include <alarm.h>
 #include <errlog.h>
 #include <dbUnitTest.h>
 #include <dbAccess.h>
@@ -80,6 +81,22 @@ struct simrunner : public epicsThreadRunable {
     }
 };
 
+// wait for async processing to complete
+void waitPACT(const char *name)
+{
+    dbCommon *prec = testdbRecordPtr(name);
+    while(1) {
+        int pact;
+        {
+            ScanLock G(prec);
+            pact = prec->pact;
+        }
+        if(!pact)
+            break;
+        epicsThreadSleep(0.01);
+    }
+}
+
 struct Channel {
     dbChannel *chan;
     Channel(const char *name)
@@ -108,7 +125,7 @@ void testfeed_registerRecordDeviceDriver(struct dbBase *);
 
 MAIN(testdevice)
 {
-    testPlan(7);
+    testPlan(23);
     try {
         simrunner sim;
 
@@ -150,19 +167,92 @@ MAIN(testdevice)
         testdbGetFieldEqual("tst:HelloInt-I", DBF_LONG, 0x48656c6c);
 
         testdbPutFieldOk("tst:One-SP", DBF_LONG, 0x12345678);
-        while(1) {
-            dbCommon *prec = testdbRecordPtr("tst:One-SP");
-            int pact;
+        waitPACT("tst:One-SP");
+
+        testOk((*sim.instance)["one"].storage[0]==0x12345678,
+                "one[0] == %08x", (unsigned)(*sim.instance)["one"].storage[0]);
+
+        {
+            DevReg *one;
             {
-                ScanLock G(prec);
-                pact = prec->pact;
+                Guard G(dev->lock);
+                one = dev->reg_by_name["one"];
+                // same as a timeout.  back to Searching
+                dev->reset();
+            }
+
+            Guard G(dev->lock);
+            for(unsigned N=50; N && dev->current!=Device::Running; N--) {
+                UnGuard U(G);
+                epicsThreadSleep(0.1);
+            }
+
+            testOk(dev->current==Device::Running, "Reconnect state %s", Device::current_name[dev->current]);
+            testOk(dev->reg_by_name["one"]==one, "Re-use register %p == %p", dev->reg_by_name["one"], one);
+            testOk(dev->reg_cache.empty(), "cache consumed");
+
+            for(unsigned N=50; N && !dev->blobs_ready; N--) {
+                UnGuard U(G);
+                epicsThreadSleep(0.1);
             }
-            if(!pact)
-                break;
+            testOk(dev->blobs_ready && !dev->raw_infos.empty(), "raw_infos %zu bytes after reconnect", dev->raw_infos.size());
+
+            epicsUInt32 offset = 0xffffffff;
+            testOk(dev->reg_by_address(32, &offset)==one && offset==0, "find by address %u", (unsigned)offset);
+            testOk(dev->reg_by_address(33)==0, "no register at 33");
+            testOk(!dev->reg_map_key.empty() && dev->reg_overlap_key==dev->reg_map_key,
+                   "overlaps checked once for this map");
         }
 
-        testOk((*sim.instance)["one"].storage[0]==0x12345678,
-                "one[0] == %08x", (unsigned)(*sim.instance)["one"].storage[0]);
+        {
+            // raw window over register "one"
+            const epicsUInt32 val = 0xdeadbeef;
+            testdbPutArrFieldOk("tst:Raw-SP", DBF_ULONG, 1, &val);
+            waitPACT("tst:Raw-SP");
+
+            testOk((*sim.instance)["one"].storage[0]==val,
+                    "raw write one[0] == %08x", (unsigned)(*sim.instance)["one"].storage[0]);
+
+            testdbPutFieldOk("tst:Raw-I.PROC", DBF_LONG, 1);
+            waitPACT("tst:Raw-I");
+            testdbGetFieldEqual("tst:Raw-I", DBF_ULONG, val);
+        }
+
+        {
+            // total loss.  write times out, and Device starts Searching again
+            {
+                Guard G(sim.instance->lock);
+                sim.instance->impair.parse("drop=1");
+            }
+            testdbPutFieldOk("tst:One-SP", DBF_LONG, 0x87654321);
+            waitPACT("tst:One-SP");
+
+            {
+                Guard G(dev->lock);
+                testOk(dev->current!=Device::Running, "Lost connection.  state %s, %u timeouts",
+                       Device::current_name[dev->current], (unsigned)dev->cnt_timo);
+            }
+
+            // raw windows only used while Running
+            testdbPutFieldOk("tst:Raw-I.PROC", DBF_LONG, 1);
+            testdbGetFieldEqual("tst:Raw-I.SEVR", DBF_SHORT, INVALID_ALARM);
+
+            {
+                Guard G(sim.instance->lock);
+                testDiag("Simulator dropped %zu replies", sim.instance->impair_stats.dropped);
+                sim.instance->impair.clear();
+            }
+
+            epicsTime start(epicsTime::getCurrent());
+
+            Guard G(dev->lock);
+            for(unsigned N=50; N && dev->current!=Device::Running; N--) {
+                UnGuard U(G);
+                epicsThreadSleep(0.1);
+            }
+
+            testOk(dev->current==Device::Running, "Recovered in %.2f sec", epicsTime::getCurrent()-start);
+        }
 
         //dev->show(std::cerr);
 
@@ -1,11 +1,14 @@
 
 #include <stdexcept>
+#include <sstream>
 #include <string.h>
 
 #include <epicsUnitTest.h>
+#include <epicsTime.h>
 #include <testMain.h>
 
 #include <jblob.h>
+#include <jregtable.h>
 
 #define testThrows(EXC, STMT) try{STMT; testFail("Statement failed to throw " #EXC " : " #STMT); }catch(std::exception& e) { testPass("Caught expected exception: %s", e.what());}
 
@@ -94,16 +97,132 @@ void testAST()
     testOk(blob.info32["slow_abi_ver"]==1, "slow_abi_ver = %d", (int)blob.info32["slow_abi_ver"]);
 }
 
+
+void testTable()
+{
+    testDiag("testTable()");
+
+    JRegTable table;
+    testOk1(table.nregs()==0);
+
+    table.parse("{}", 2);
+    testOk1(table.nregs()==0);
+
+    testThrows(std::runtime_error, table.parse("{foo");)
+    testThrows(std::runtime_error, table.parse("{\"A\":{\"B\":{\"C\":4}}}");)
+    testThrows(std::runtime_error, table.parse("{\"\":5}");)
+
+    const char bigblob[] = "{"
+                           "\"somenum\": {""\"access\": \"rw\", \"addr_width\": 2, \"sign\": \"signed\", \"base_addr\": 65, \"data_width\": \"32\", \"description\": \"Some number\"},"
+                           "\"J18_debug\": {""\"access\": \"r\", \"addr_width\": 0, \"sign\": \"unsigned\", \"base_addr\": 63, \"data_width\": \"0x4\"},"
+                           "\"bad\": {""\"access\": \"r\", \"addr_width\": 40},"
+                           "\"dup\": {""\"base_addr\": 1},"
+                           "\"dup\": {""\"base_addr\": 2},"
+                           "\"__metadata__\": {\"slow_abi_ver\": 1}"
+                           "}";
+
+    table.parse(bigblob);
+
+    testOk(table.nregs()==3, "nregs %u", (unsigned)table.nregs());
+    testOk1(table.find("bad")==table.nregs());
+    testOk1(table.find("__metadata__")==table.nregs());
+
+    JBlob::info32_t info32;
+    table.get(info32);
+    testOk(info32["slow_abi_ver"]==1, "slow_abi_ver = %d", (int)info32["slow_abi_ver"]);
+
+    // serialize and re-load
+    std::vector<char> image(table.data(), table.data()+table.size());
+    JRegTable copy;
+    copy.load(&image[0], image.size());
+
+    size_t idx = copy.find("dup");
+    testOk(idx<copy.nregs() && copy.entry(idx).base_addr==2, "dup last definition wins");
+
+    idx = copy.find("J18_debug");
+    testOk1(idx<copy.nregs());
+    if(idx<copy.nregs()) {
+        JRegister reg;
+        copy.get(idx, reg);
+        testOk(reg.name=="J18_debug", "name %s", reg.name.c_str());
+        testOk(reg.base_addr==63, "base_addr %u", (unsigned)reg.base_addr);
+        testOk(reg.data_width==4, "data_width %u", (unsigned)reg.data_width);
+        testOk(reg.sign==JRegister::Unsigned, "sign %u", (unsigned)reg.sign);
+        testOk1(reg.readable && !reg.writable);
+    } else {
+        testSkip(5, "failed to find");
+    }
+
+    JRegTable view;
+    view.attach(&image[0], image.size());
+    idx = view.find("somenum");
+    testOk1(idx<view.nregs());
+    if(idx<view.nregs()) {
+        JRegister reg;
+        view.get(idx, reg);
+        testOk(reg.addr_width==2, "addr_width %u", (unsigned)reg.addr_width);
+        testOk(reg.sign==JRegister::Signed, "sign %u", (unsigned)reg.sign);
+        testOk1(reg.readable && reg.writable);
+        testOk(reg.description=="Some number", "description \"%s\"", reg.description.c_str());
+    } else {
+        testSkip(4, "failed to find");
+    }
+
+    image[0] = 'X';
+    testThrows(std::runtime_error, view.attach(&image[0], image.size()));
+    image[0] = 'F';
+    testThrows(std::runtime_error, view.attach(&image[0], 16));
+}
+
+// Not a pass/fail test.  Timing for comparison
+void benchmark()
+{
+    testDiag("benchmark()");
+
+    // ~3MB
+    std::ostringstream strm;
+    strm<<"{";
+    for(unsigned i=0; i<20000; i++) {
+        strm<<"\"some_long_register_name_"<<i<<"\": {"
+              "\"access\": \"rw\", \"addr_width\": 0, \"sign\": \"unsigned\", \"base_addr\": "<<(i+1024)<<", \"data_width\": 18, "
+              "\"description\": \"A moderately long description of register number "<<i<<"\"},\n";
+    }
+    strm<<"\"__metadata__\": {\"slow_abi_ver\": 1}}";
+    std::string json(strm.str());
+
+    const unsigned N = 5;
+
+    epicsTime start(epicsTime::getCurrent());
+    for(unsigned i=0; i<N; i++) {
+        JBlob blob;
+        blob.parse(json.c_str(), json.size());
+    }
+    epicsTime mid(epicsTime::getCurrent());
+    for(unsigned i=0; i<N; i++) {
+        JRegTable table;
+        table.parse(json.c_str(), json.size());
+    }
+    epicsTime end(epicsTime::getCurrent());
+
+    JRegTable table;
+    table.parse(json.c_str(), json.size());
+
+    testDiag("parse %u bytes.  JBlob %.1f ms, JRegTable %.1f ms (image %u bytes)",
+             (unsigned)json.size(), (mid-start)/N*1e3, (end-mid)/N*1e3, (unsigned)table.size());
+}
+
 }
 
 MAIN(testjson)
 {
-    testPlan(25);
+    testPlan(48);
     try {
         testEmpty();
         testSyntaxError();
         testMyErrors();
         testAST();
+        testTable();
+        benchmark();
 
     }catch(std::exception& e){
         testAbort("Uncaught exception: %s", e.what());
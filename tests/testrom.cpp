@@ -11,6 +11,7 @@
 #include <testMain.h>
 
 #include "utils.h"
+#include "zpp.h"
 #include "rom.h"
 
 namespace {
@@ -185,6 +186,78 @@ void testEncode()
     testOk(counts[3]==1, "counts[3] = %u", counts[3]);
 }
 
+
+void testView()
+{
+    testDiag("testView()");
+
+    std::vector<char> romblob, json;
+
+    readfile(romblob, "../rom.bin");
+    readfile(json, "../jblob.json");
+
+    ROMView view(&romblob[0], romblob.size());
+
+    unsigned counts[4];
+    memset(counts, 0, sizeof(counts));
+
+    std::vector<char> out, scratch;
+    ZInflater Z;
+    std::string value;
+
+    for(ROMView::const_iterator it=view.begin(), end=view.end(); it!=end; ++it)
+    {
+        const ROMView::Entry& desc=*it;
+
+        testDiag("ROMView::Entry type=%u nbytes=%u", unsigned(desc.type), unsigned(desc.nbytes));
+
+        if(desc.type==ROMDescriptor::BigInt && counts[desc.type]==0) {
+            desc.decode(value);
+            testOk(value=="576ca77f06293551faeb568e427d97045f37f2c6",
+                   "BigInt0 value = \"%s\"", value.c_str());
+        } else if(desc.type==ROMDescriptor::JSON) {
+            // twice to re-use buffers
+            desc.inflate(out, scratch, Z);
+            desc.inflate(out, scratch, Z);
+            out.push_back('\n');
+            testOk1(out==json);
+        }
+
+        if(desc.type<4)
+            counts[desc.type]++;
+    }
+
+    testOk(counts[1]==1 && counts[2]==2 && counts[3]==1, "counts %u %u %u %u",
+           counts[0], counts[1], counts[2], counts[3]);
+
+    // ROMWriter compatible with ROM::prepare()
+    std::vector<char> blob1(4096, 0), blob2(4096, 0);
+
+    ROM rom;
+    rom.push_back(ROMDescriptor::Text, "Hello World");
+    rom.push_back(ROMDescriptor::BigInt, "12345678abcde");
+    rom.push_back(ROMDescriptor::JSON, "{}");
+
+    blob1.resize(rom.prepare(&blob1[0], blob1.size()));
+
+    ROMWriter W(&blob2[0], blob2.size());
+    W.text("Hello World", 11);
+    W.bigint("12345678abcde");
+    W.json("{}", 2);
+    blob2.resize(W.finish());
+
+    testOk1(blob1==blob2);
+
+    char small[16];
+    ROMWriter W2(small, sizeof(small));
+    try {
+        W2.text("Hello World", 11);
+        testFail("Missing expected exception");
+    }catch(std::runtime_error& e){
+        testPass("Caught expected exception: %s", e.what());
+    }
+}
+
 }
 
 MAIN(testrom)
@@ -193,6 +266,7 @@ MAIN(testrom)
     try {
         testDecode();
         testEncode();
+        testView();
 
         errlogFlush();
     }catch(std::exception& e){
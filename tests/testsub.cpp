@@ -1,10 +1,13 @@
 #include <stdexcept>
+#include <string>
+#include <complex>
 
 #include <errlog.h>
 #include <epicsMath.h>
 #include <dbUnitTest.h>
 #include <testMain.h>
 #include <dbAccess.h>
+#include <alarm.h>
 
 extern "C" {
 void testfeed_registerRecordDeviceDriver(struct dbBase *);
@@ -130,9 +133,452 @@ void test_bcat()
     testdbGetFieldEqual("bcat.VALA", DBF_LONG, -32100);
 }
 
+static
+void putArrDouble(const char *pv, size_t N, const double *arr)
+{
+    DBADDR addr;
+
+    if (dbNameToAddr(pv, &addr)) {
+        testFail("Missing PV \"%s\"", pv);
+        return;
+    }
+
+    long status = dbPutField(&addr, DBF_DOUBLE, (const void*)arr, long(N));
+    testOk(status==0, "putArr %s with %zu elem", pv, N);
+}
+
+static
+void getArrDouble(const char *pv, size_t N, double *arr)
+{
+    DBADDR addr;
+    long nReq = long(N);
+
+    if (dbNameToAddr(pv, &addr)) {
+        testFail("Missing PV \"%s\"", pv);
+        return;
+    }
+
+    long status = dbGetField(&addr, DBF_DOUBLE, (void*)arr, 0, &nReq, 0);
+    testOk(status==0 && nReq==long(N), "getArr %s with %ld elem", pv, nReq);
+}
+
+// fast phase approximation must agree with atan2()
+static
+void test_iq2ap_fast()
+{
+    static const double I[] = {1.0, 0.0, -1.0, 0.0, -1.0, -1.0, 0.0, 1e-300, 0.3, -0.7, 2.0, -3e5, 1.0, -1.0, 0.5, 1e6, epicsNAN, 1.0};
+    static const double Q[] = {0.0, 1.0, 0.0, -1.0, 1e-12, -1e-12, 0.0, -1e-300, 0.4, -0.2, 2.0, 7e4, -1e-9, 0.5, -0.866, -1.0, 1.0, epicsNAN};
+    const size_t N = NELEMENTS(I);
+    double amp[2][NELEMENTS(I)], pha[2][NELEMENTS(I)];
+    const char *recs[2] = {"iq2ap", "iq2apfast"};
+
+    testDiag("test_iq2ap_fast()");
+
+    for(size_t r=0; r<2; r++) {
+        std::string name(recs[r]);
+        putArrDouble((name+".A").c_str(), N, I);
+        putArrDouble((name+".B").c_str(), N, Q);
+        testdbPutFieldOk((name+".PROC").c_str(), DBF_LONG, 1);
+        testdbGetFieldEqual((name+".SEVR").c_str(), DBF_SHORT, 0);
+        getArrDouble((name+".VALA").c_str(), N, amp[r]);
+        getArrDouble((name+".VALB").c_str(), N, pha[r]);
+    }
+
+    for(size_t i=0; i<N; i++) {
+        double delta = fabs(pha[1][i]-pha[0][i]);
+        // -180 and 180 are the same phase
+        if(delta > 180.0)
+            delta = 360.0 - delta;
+        if(isnan(I[i]) || isnan(Q[i])) {
+            testOk(isnan(pha[0][i]) && isnan(pha[1][i]) && isnan(amp[0][i]) && isnan(amp[1][i]),
+                   "[%zu] I=%g Q=%g pha %g, %g amp %g, %g", i, I[i], Q[i],
+                   pha[0][i], pha[1][i], amp[0][i], amp[1][i]);
+            continue;
+        }
+        testOk(delta < 1e-6 && amp[0][i]==amp[1][i] && pha[1][i]>=-180.0 && pha[1][i]<180.0,
+               "[%zu] I=%g Q=%g pha %.9f ~= %.9f amp %g == %g", i, I[i], Q[i],
+               pha[0][i], pha[1][i], amp[0][i], amp[1][i]);
+    }
+}
+
+static
+void test_iq2ap_stats()
+{
+    // window of time [2, 6) selects elements 2-5
+    static const double I[] = {1.0, 1.0, 3.0, 0.0, -5.0, 0.0, 9.0, 9.0};
+    static const double Q[] = {1.0, 1.0, 0.0, 4.0, 0.0, -6.0, 9.0, 9.0};
+    static const double T[] = {0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0};
+    double amp[NELEMENTS(I)];
+
+    testDiag("test_iq2ap_stats()");
+
+    putArrDouble("iq2apstats.A", NELEMENTS(I), I);
+    putArrDouble("iq2apstats.B", NELEMENTS(Q), Q);
+    putArrDouble("iq2apstats.G", NELEMENTS(T), T);
+    testdbPutFieldOk("iq2apstats.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("iq2apstats.SEVR", DBF_SHORT, 0);
+
+    getArrDouble("iq2apstats.VALA", NELEMENTS(I), amp);
+    testOk(amp[0]==sqrt(2.0) && amp[4]==5.0 && amp[7]==sqrt(162.0),
+           "amplitude %g %g %g", amp[0], amp[4], amp[7]);
+
+    // amplitude 3, 4, 5, 6
+    testApproxEqual("iq2apstats.VALD", 4.5, 1e-6);
+    testApproxEqual("iq2apstats.VALE", 1.118034, 1e-6);
+    testApproxEqual("iq2apstats.VALF", 3.0, 1e-6);
+    testApproxEqual("iq2apstats.VALG", 6.0, 1e-6);
+    testApproxEqual("iq2apstats.VALH", 0.248452, 1e-6);
+    testApproxEqual("iq2apstats.VALI", 3.0, 1e-6);
+    testApproxEqual("iq2apstats.VALJ", 4.636809, 1e-6);
+
+    // phase 0, 90, 180, -90
+    testApproxEqual("iq2apstats.VALK", 45.0, 1e-6);
+    testApproxEqual("iq2apstats.VALL", 100.623059, 1e-6);
+    testApproxEqual("iq2apstats.VALM", -90.0, 1e-6);
+    testApproxEqual("iq2apstats.VALN", 180.0, 1e-6);
+    testApproxEqual("iq2apstats.VALO", 2.236068, 1e-6);
+    testApproxEqual("iq2apstats.VALP", 270.0, 1e-6);
+    testApproxEqual("iq2apstats.VALQ", 110.227038, 1e-6);
+}
+
+static
+void test_wf_stats()
+{
+    // large offset, non-uniform time
+    static const double Y[] = {0.0, 1e9+1.0, 1e9-1.0, 1e9+1.0, 1e9-1.0, 1e9+1.0, 1e9-1.0, 0.0};
+    static const double X[] = {0.0, 1.0, 1.5, 1.5, 4.0, 8.0, 8.5, 100.0};
+
+    testDiag("test_wf_stats()");
+
+    putArrDouble("wfstats.A", NELEMENTS(Y), Y);
+    putArrDouble("wfstats.B", NELEMENTS(X), X);
+
+    // elements 1-6
+    testdbPutFieldOk("wfstats.C", DBF_DOUBLE, 1.0);
+    testdbPutFieldOk("wfstats.D", DBF_DOUBLE, 8.6);
+    testdbPutFieldOk("wfstats.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wfstats.SEVR", DBF_SHORT, 0);
+    testApproxEqual("wfstats.VALA", 1e9, 1e-6);
+    testApproxEqual("wfstats.VALB", 1.0, 1e-6);
+    testApproxEqual("wfstats.VALC", 1e9-1.0, 0.0);
+    testApproxEqual("wfstats.VALD", 1e9+1.0, 0.0);
+
+    // elements 2-4.  end excluded
+    testdbPutFieldOk("wfstats.C", DBF_DOUBLE, 1.5);
+    testdbPutFieldOk("wfstats.D", DBF_DOUBLE, 6.5);
+    testdbPutFieldOk("wfstats.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wfstats.SEVR", DBF_SHORT, 0);
+    testApproxEqual("wfstats.VALA", 1e9-1.0/3.0, 1e-6);
+    testApproxEqual("wfstats.VALB", sqrt(8.0/9.0), 1e-6);
+
+    // empty window
+    testdbPutFieldOk("wfstats.C", DBF_DOUBLE, 9.0);
+    testdbPutFieldOk("wfstats.D", DBF_DOUBLE, 1.0);
+    testdbPutFieldOk("wfstats.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wfstats.SEVR", DBF_SHORT, INVALID_ALARM);
+}
+
+static
+void test_wf_stats_multi()
+{
+    double Y[512], X[512];
+    // long windows use prefix sums, short are direct
+    static const double start[] = {0.0, 100.0, 10.0, 600.0, 0.0};
+    static const double width[] = {512.0, 300.0, 10.0, 100.0, 512.0};
+    static const double emean[] = {255.5, 249.5, 14.5, epicsNAN, 255.5};
+    static const double emin[]  = {0.0, 100.0, 10.0, epicsNAN, 0.0};
+    static const double emax[]  = {511.0, 399.0, 19.0, epicsNAN, 511.0};
+    const size_t W = NELEMENTS(start);
+    double mean[NELEMENTS(start)], std[NELEMENTS(start)], min[NELEMENTS(start)], max[NELEMENTS(start)];
+
+    testDiag("test_wf_stats_multi()");
+
+    for(size_t i=0; i<NELEMENTS(Y); i++) {
+        Y[i] = X[i] = i;
+    }
+
+    putArrDouble("wfstatsmulti.A", NELEMENTS(Y), Y);
+    putArrDouble("wfstatsmulti.B", NELEMENTS(X), X);
+    putArrDouble("wfstatsmulti.C", W, start);
+    putArrDouble("wfstatsmulti.D", W, width);
+    testdbPutFieldOk("wfstatsmulti.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wfstatsmulti.SEVR", DBF_SHORT, 0);
+
+    getArrDouble("wfstatsmulti.VALA", W, mean);
+    getArrDouble("wfstatsmulti.VALB", W, std);
+    getArrDouble("wfstatsmulti.VALC", W, min);
+    getArrDouble("wfstatsmulti.VALD", W, max);
+
+    for(size_t w=0; w<W; w++) {
+        // std of N consecutive integers
+        double N = width[w],
+               estd = sqrt((N*N - 1.0)/12.0);
+        if(isnan(emean[w])) {
+            testOk(isnan(mean[w]) && isnan(std[w]) && isnan(min[w]) && isnan(max[w]),
+                   "[%zu] empty %g %g %g %g", w, mean[w], std[w], min[w], max[w]);
+        } else {
+            testOk(fabs(mean[w]-emean[w])<1e-9 && fabs(std[w]-estd)<1e-9
+                   && min[w]==emin[w] && max[w]==emax[w],
+                   "[%zu] mean %g std %g (%g) min %g max %g", w, mean[w], std[w], estd, min[w], max[w]);
+        }
+    }
+
+    // non-finite samples only affect windows which include them
+    Y[0] = -INFINITY; // eg. dBm of zero
+    Y[5] = epicsNAN;
+    putArrDouble("wfstatsmulti.A", NELEMENTS(Y), Y);
+    testdbPutFieldOk("wfstatsmulti.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wfstatsmulti.SEVR", DBF_SHORT, 0);
+
+    getArrDouble("wfstatsmulti.VALA", W, mean);
+    getArrDouble("wfstatsmulti.VALC", W, min);
+    getArrDouble("wfstatsmulti.VALD", W, max);
+
+    testOk(isnan(mean[0]) && min[0]==-INFINITY && max[0]==511.0,
+           "[0] with -inf and NaN: mean %g min %g max %g", mean[0], min[0], max[0]);
+    for(size_t w=1; w<3; w++) {
+        testOk(fabs(mean[w]-emean[w])<1e-9 && min[w]==emin[w] && max[w]==emax[w],
+               "[%zu] without: mean %g min %g max %g", w, mean[w], min[w], max[w]);
+    }
+}
+
+static
+void test_wggen()
+{
+    static const double B[] = {1.0, 2.0, 3.0};
+    static const double C[] = {2.0};
+    static const double D[] = {3.0};
+    double out[3];
+
+    testDiag("test_wggen()");
+
+    // shorter inputs repeat their last value
+    putArrDouble("wggen.B", NELEMENTS(B), B);
+    putArrDouble("wggen.C", NELEMENTS(C), C);
+    putArrDouble("wggen.D", NELEMENTS(D), D);
+
+    testdbPutFieldOk("wggen.A", DBF_STRING, "B*C+D*2");
+    testdbPutFieldOk("wggen.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wggen.SEVR", DBF_SHORT, 0);
+    getArrDouble("wggen.VALA", NELEMENTS(out), out);
+    testOk(out[0]==8.0 && out[1]==10.0 && out[2]==12.0,
+           "B*C+D*2 -> %g %g %g", out[0], out[1], out[2]);
+
+    testdbPutFieldOk("wggen.A", DBF_STRING, "SIN(B)+SQRT(C)");
+    testdbPutFieldOk("wggen.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("wggen.SEVR", DBF_SHORT, 0);
+    getArrDouble("wggen.VALA", NELEMENTS(out), out);
+    testOk(out[0]==sin(1.0)+sqrt(2.0) && out[1]==sin(2.0)+sqrt(2.0) && out[2]==sin(3.0)+sqrt(2.0),
+           "SIN(B)+SQRT(C) -> %g %g %g", out[0], out[1], out[2]);
+
+    // MIN/MAX of 3 and 4 args where the first, computed, arg is the extreme
+    static const struct {
+        const char *expr;
+        double expect[3];
+    } minmax[] = {
+        {"MIN(B-2,C,D)",     {-1.0, 0.0, 1.0}},
+        {"MAX(B*3,C,D)",     {3.0, 6.0, 9.0}},
+        {"MIN(B-2,C,D,C*D)", {-1.0, 0.0, 1.0}},
+        {"MAX(B+4,C,D,C+D)", {5.0, 6.0, 7.0}},
+    };
+    for(size_t i=0; i<NELEMENTS(minmax); i++) {
+        testdbPutFieldOk("wggen.A", DBF_STRING, minmax[i].expr);
+        testdbPutFieldOk("wggen.PROC", DBF_LONG, 1);
+        testdbGetFieldEqual("wggen.SEVR", DBF_SHORT, 0);
+        getArrDouble("wggen.VALA", NELEMENTS(out), out);
+        testOk(out[0]==minmax[i].expect[0] && out[1]==minmax[i].expect[1] && out[2]==minmax[i].expect[2],
+               "%s -> %g %g %g", minmax[i].expr, out[0], out[1], out[2]);
+    }
+}
+
+// exact and fast modes against the rotation written out
+static
+void test_ctrl()
+{
+    static const double I[] = {1.0, 0.0, -1.0, 0.5};
+    static const double Q[] = {0.0, 1.0, 0.0, -0.5};
+    static const double P[] = {0.0, 90.0, -45.0, 400.0};
+    const size_t N = NELEMENTS(I);
+    double out[2][6][NELEMENTS(I)];
+    const char *recs[2] = {"ctrl", "ctrlfast"};
+    const double pi = 3.14159265359; // as calc.c
+
+    testDiag("test_ctrl()");
+
+    putArrDouble("ctrl:I", N, I);
+    putArrDouble("ctrl:Q", N, Q);
+    putArrDouble("ctrl:P", N, P);
+
+    for(size_t r=0; r<2; r++) {
+        std::string name(recs[r]);
+        testdbPutFieldOk((name+".PROC").c_str(), DBF_LONG, 1);
+        testdbGetFieldEqual((name+".SEVR").c_str(), DBF_SHORT, 0);
+        for(size_t o=0; o<6; o++) {
+            char fld[] = ".VALA";
+            fld[4] += char(o);
+            getArrDouble((name+fld).c_str(), N, out[r][o]);
+        }
+    }
+
+    for(size_t i=0; i<N; i++) {
+        // offset 10 deg., gain 2
+        double rot = (P[i] - 10.0)*pi/180.0,
+               ci = (I[i]*cos(-rot) - Q[i]*sin(-rot))*2.0,
+               cq = -(I[i]*sin(-rot) + Q[i]*cos(-rot))*2.0,
+               cp = atan2(cq, ci)*180.0/pi;
+        bool ok = true;
+        for(size_t r=0; r<2; r++) {
+            double dp = fabs(out[r][2][i] - cp);
+            if(dp > 180.0)
+                dp = 360.0 - dp;
+            ok &= fabs(out[r][0][i] - ci) < 1e-9
+                    && fabs(out[r][1][i] - cq) < 1e-9
+                    && dp < 1e-6
+                    && fabs(out[r][3][i] - sqrt(ci*ci + cq*cq)) < 1e-9
+                    && out[r][5][i] == P[i] - 10.0;
+        }
+        testOk(ok, "[%zu] I=%g Q=%g P=%g -> %g %g pha %.9f ~= %.9f ~= %.9f", i, I[i], Q[i], P[i],
+               out[0][0][i], out[0][1][i], cp, out[0][2][i], out[1][2][i]);
+    }
+}
+
+// fc, df, bw at [i] from the complex formula, with end points
+// copied from their neighbours as calc_df() does.
+static
+void detune_expect(const double *CI, const double *CQ, const double *FI, const double *FQ,
+                   size_t N, size_t i, double out[3])
+{
+    typedef std::complex<double> cplx;
+    const double pi = 3.14159265359; // as calc.c
+    const double cavscl = 2.0, fwdscl = 0.5, sampt = 1e-6;
+    const cplx bcoef(std::polar(100.0, 30.0*pi/180.0));
+
+    if(i==0)
+        i = 1;
+    else if(i==N-1)
+        i = N-2;
+
+    cplx cav(CI[i]/cavscl, CQ[i]/cavscl),
+         fwd(FI[i]/fwdscl, FQ[i]/fwdscl),
+         dvdt((cplx(CI[i+1], CQ[i+1]) - cplx(CI[i-1], CQ[i-1]))/(2.0*sampt*cavscl)),
+         fc(dvdt/(2.0*pi*cav)),
+         a((dvdt - bcoef*fwd)/(2.0*pi*cav));
+
+    out[0] = fc.imag();
+    out[1] = a.imag();
+    out[2] = -a.real();
+}
+
+static
+bool detune_close(double actual, double expected)
+{
+    return fabs(actual - expected) <= 1e-9*fabs(expected);
+}
+
+static
+void test_detune()
+{
+    double CI[] = {1.0, 0.9, 0.7, 0.4, 0.0, -0.5};
+    double CQ[] = {0.0, 0.2, 0.5, 0.7, 0.9, 0.8};
+    static const double FI[] = {1.0, 1.1, 1.2, 1.1, 1.0, 0.9};
+    static const double FQ[] = {0.1, 0.0, -0.1, -0.2, -0.1, 0.0};
+    const size_t N = NELEMENTS(CI);
+    double fc[N], df[N], bw[N], expect[3];
+
+    testDiag("test_detune()");
+
+    putArrDouble("detune:CI", N, CI);
+    putArrDouble("detune:CQ", N, CQ);
+    putArrDouble("detune:FI", N, FI);
+    putArrDouble("detune:FQ", N, FQ);
+    testdbPutFieldOk("detune.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("detune.SEVR", DBF_SHORT, 0);
+    getArrDouble("detune.VALE", N, fc);
+    getArrDouble("detune.VALA", N, df);
+    getArrDouble("detune.VALB", N, bw);
+
+    for(size_t i=0; i<N; i++) {
+        detune_expect(CI, CQ, FI, FQ, N, i, expect);
+        testOk(detune_close(fc[i], expect[0]) && detune_close(df[i], expect[1]) && detune_close(bw[i], expect[2]),
+               "[%zu] fc %g ~= %g  df %g ~= %g  bw %g ~= %g", i,
+               fc[i], expect[0], df[i], expect[1], bw[i], expect[2]);
+    }
+
+    // zero cavity phasor gives non-finite results, but only at [3]
+    CI[3] = CQ[3] = 0.0;
+    putArrDouble("detune:CI", N, CI);
+    putArrDouble("detune:CQ", N, CQ);
+    testdbPutFieldOk("detune.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("detune.SEVR", DBF_SHORT, 0);
+    getArrDouble("detune.VALE", N, fc);
+    getArrDouble("detune.VALA", N, df);
+    getArrDouble("detune.VALB", N, bw);
+
+    testOk(!isfinite(fc[3]) && !isfinite(df[3]) && !isfinite(bw[3]),
+           "zero cavity fc %g df %g bw %g", fc[3], df[3], bw[3]);
+    {
+        bool ok = true;
+        for(size_t i=0; i<N; i++) {
+            if(i==3)
+                continue;
+            detune_expect(CI, CQ, FI, FQ, N, i, expect);
+            ok &= detune_close(fc[i], expect[0]) && detune_close(df[i], expect[1]) && detune_close(bw[i], expect[2]);
+        }
+        testOk(ok, "neighbours of zero cavity unaffected");
+    }
+
+    // central difference needs 3 points
+    putArrDouble("detune:CI", 2, CI);
+    testdbPutFieldOk("detune.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("detune.SEVR", DBF_SHORT, INVALID_ALARM);
+    testdbGetFieldEqual("detune.NEVA", DBF_ULONG, 0);
+}
+
+// Itoh mode, continuing across calls
+static
+void test_unwrap_itoh()
+{
+    static const double A[] = {170.0, -170.0, -150.0, 170.0, 10.0, -100.0, 100.0, 0.0};
+    static const double B[] = {10.0, 20.0};
+    double out[NELEMENTS(A)];
+
+    testDiag("test_unwrap_itoh()");
+
+    putArrDouble("unwrapitoh.A", NELEMENTS(A), A);
+    testdbPutFieldOk("unwrapitoh.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("unwrapitoh.SEVR", DBF_SHORT, 0);
+    getArrDouble("unwrapitoh.VALA", NELEMENTS(A), out);
+    testOk(out[0]==170.0 && out[1]==190.0 && out[2]==210.0 && out[3]==170.0
+           && out[4]==10.0 && out[5]==-100.0 && out[6]==-260.0 && out[7]==-360.0,
+           "unwrapped %g %g %g %g %g %g %g %g",
+           out[0], out[1], out[2], out[3], out[4], out[5], out[6], out[7]);
+    testApproxEqual("unwrapitoh.VALB", -360.0, 0.0);
+
+    // continues from -360
+    putArrDouble("unwrapitoh.A", NELEMENTS(B), B);
+    testdbPutFieldOk("unwrapitoh.PROC", DBF_LONG, 1);
+    getArrDouble("unwrapitoh.VALA", NELEMENTS(B), out);
+    testOk(out[0]==-350.0 && out[1]==-340.0, "continued %g %g", out[0], out[1]);
+
+    // restart
+    testdbPutFieldOk("unwrapitoh.VALB", DBF_DOUBLE, 0.0);
+    testdbPutFieldOk("unwrapitoh.PROC", DBF_LONG, 1);
+    getArrDouble("unwrapitoh.VALA", NELEMENTS(B), out);
+    testOk(out[0]==10.0 && out[1]==20.0, "restarted %g %g", out[0], out[1]);
+
+    // Max Difference (B) is not needed in this mode
+    putArrDouble("unwrapitoh.B", 0, B);
+    testdbPutFieldOk("unwrapitoh.VALB", DBF_DOUBLE, 0.0);
+    putArrDouble("unwrapitoh.A", NELEMENTS(B), B);
+    testdbPutFieldOk("unwrapitoh.PROC", DBF_LONG, 1);
+    testdbGetFieldEqual("unwrapitoh.SEVR", DBF_SHORT, 0);
+    getArrDouble("unwrapitoh.VALA", NELEMENTS(B), out);
+    testOk(out[0]==10.0 && out[1]==20.0, "without B %g %g", out[0], out[1]);
+}
+
 MAIN(testsub)
 {
-    testPlan(76);
+    testPlan(261);
     try {
         testdbPrepare();
 
@@ -147,6 +593,14 @@ MAIN(testsub)
 
         test_yscale();
         test_bcat();
+        test_iq2ap_fast();
+        test_iq2ap_stats();
+        test_wf_stats();
+        test_wf_stats_multi();
+        test_wggen();
+        test_ctrl();
+        test_unwrap_itoh();
+        test_detune();
 
         testIocShutdownOk();
 
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include <epicsUnitTest.h>
+#include <epicsTime.h>
 #include <testMain.h>
 
 #include "utils.h"
@@ -80,14 +81,112 @@ void testBig()
 
     testOk1(json==actual);
 }
+
+void testGrowth()
+{
+    testDiag("testGrowth()");
+
+    // compresses ~1000:1, so output must grow several times
+    std::vector<char> zeros(1024*1024, '\0'), comp, actual;
+
+    zdeflate(comp, &zeros[0], zeros.size());
+    testDiag("compressed %u -> %u", (unsigned)zeros.size(), (unsigned)comp.size());
+
+    zinflate(actual, &comp[0], comp.size());
+    testOk1(zeros==actual);
+
+    // truncated input
+    testThrows(std::runtime_error, zinflate(actual, &comp[0], comp.size()/2));
+}
+
+void testReuse()
+{
+    testDiag("testReuse()");
+
+    std::vector<char> json, comp, actual;
+    readfile(json, "../jblob.json");
+    readfile(comp, "../jblob.json.z");
+
+    ZInflater I;
+    for(unsigned i=0; i<2; i++) {
+        I.inflate(actual, &comp[0], comp.size());
+        testOk(json==actual, "re-use inflate #%u", i);
+    }
+
+    // into caller buffer of exact size
+    std::vector<char> buf(json.size());
+    size_t len = I.inflate(&buf[0], buf.size(), &comp[0], comp.size());
+    testOk(len==json.size() && json==buf, "inflate caller buffer %u", (unsigned)len);
+
+    testThrows(std::runtime_error, I.inflate(&buf[0], buf.size()-1, &comp[0], comp.size()));
+
+    ZDeflater D(9);
+    std::vector<char> comp2(D.bound(json.size()));
+    len = D.deflate(&comp2[0], comp2.size(), &json[0], json.size());
+    comp2.resize(len);
+
+    I.inflate(actual, &comp2[0], comp2.size());
+    testOk(json==actual, "deflate caller buffer %u", (unsigned)len);
+
+    D.deflate(comp2, &json[0], json.size());
+    I.inflate(actual, &comp2[0], comp2.size());
+    testOk(json==actual, "re-use deflate %u", (unsigned)comp2.size());
+}
+
+// Not a pass/fail test.  Timing for comparison
+void benchmark()
+{
+    testDiag("benchmark()");
+
+    std::vector<char> json, comp, actual;
+    readfile(json, "../jblob.json");
+    readfile(comp, "../jblob.json.z");
+
+    const unsigned N = 100;
+
+    epicsTime start(epicsTime::getCurrent());
+    for(unsigned i=0; i<N; i++) {
+        std::vector<char> out;
+        zinflate(out, &comp[0], comp.size());
+    }
+    epicsTime mid(epicsTime::getCurrent());
+    ZInflater I;
+    for(unsigned i=0; i<N; i++) {
+        I.inflate(actual, &comp[0], comp.size());
+    }
+    epicsTime end(epicsTime::getCurrent());
+
+    testDiag("inflate %u -> %u bytes.  zinflate() %.1f us, ZInflater re-use %.1f us",
+             (unsigned)comp.size(), (unsigned)json.size(),
+             (mid-start)/N*1e6, (end-mid)/N*1e6);
+
+    start = epicsTime::getCurrent();
+    for(unsigned i=0; i<N; i++) {
+        std::vector<char> out;
+        zdeflate(out, &json[0], json.size(), 9);
+    }
+    mid = epicsTime::getCurrent();
+    ZDeflater D(9);
+    for(unsigned i=0; i<N; i++) {
+        D.deflate(actual, &json[0], json.size());
+    }
+    end = epicsTime::getCurrent();
+
+    testDiag("deflate(9) %u bytes.  zdeflate() %.1f us, ZDeflater re-use %.1f us",
+             (unsigned)json.size(),
+             (mid-start)/N*1e6, (end-mid)/N*1e6);
+}
 }
 
 MAIN(testjson)
 {
-    testPlan(4);
+    testPlan(12);
     try {
         testInflate();
         testBig();
+        testGrowth();
+        testReuse();
+        benchmark();
 
     }catch(std::exception& e){
         testAbort("Uncaught exception: %s", e.what());
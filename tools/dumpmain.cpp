@@ -0,0 +1,395 @@
+#include <stdexcept>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <stdio.h>
+
+#include <epicsGetopt.h>
+#include <epicsStdlib.h>
+#include <epicsStdio.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsExit.h>
+#include <callback.h>
+
+#include "utils.h"
+#include "device.h"
+
+namespace {
+
+void usage(const char* exe)
+{
+    std::cout<<"Usage: "<<exe<<" [-hdvbZ] [-w <inflight>] [-t <sec>] [-o <file>] <host>[:<port>] [spec ...]\n"
+               "\n"
+               " Read, or write, registers using the same protocol engine as the IOC driver.\n"
+               " With no spec, read all readable registers described by the device JSON.\n"
+               "\n"
+               " spec:\n"
+               "   <name>                     Read register by name\n"
+               "   <addr>:<count>             Read <count> words from address <addr>\n"
+               "   <name|addr>=<val>[,<val>]  Write values.  Count taken from number of values,\n"
+               "                              which must match the size of a named register\n"
+               "   <name|addr>=@<file>        Write big endian 32-bit words from file\n"
+               "\n"
+               " -w <inflight>  Number of concurrent requests.  Default 4\n"
+               " -t <sec>       Request timeout.  Default 1.0\n"
+               " -o <file>      Write output to file instead of stdout\n"
+               " -b             Binary output.  Big endian 32-bit words\n"
+               " -Z             Text output omits zero values\n"
+               " -v             Print transfer statistics, and the register\n"
+               "                containing each address, to stderr\n"
+               " -d             Enable driver debug prints\n";
+}
+
+// shared by all requests
+struct Waiter {
+    epicsMutex lock;
+    epicsEvent evt;
+    size_t remaining;
+    Waiter() :remaining(0u) {}
+};
+
+struct Request final : public RegInterest
+{
+    std::string spec, name;
+    // for an address, the ROM register containing it (if any)
+    std::string within;
+    epicsUInt32 addr, count;
+    bool write;
+    std::vector<epicsUInt32> values; // host order
+
+    Waiter& waiter;
+
+    Request(Device *dev, Waiter& waiter)
+        :RegInterest(0, dev)
+        ,addr(0u)
+        ,count(0u)
+        ,write(false)
+        ,waiter(waiter)
+    {}
+    virtual ~Request() {}
+
+    // called from Device worker, unlocked
+    virtual void complete() override final
+    {
+        Guard G(waiter.lock);
+        waiter.remaining--;
+        waiter.evt.signal();
+    }
+
+    void parse(const std::string& s)
+    {
+        spec = s;
+        std::string target(s), value;
+
+        size_t sep = s.find('=');
+        if(sep!=s.npos) {
+            write = true;
+            target = s.substr(0, sep);
+            value = s.substr(sep+1);
+        }
+
+        sep = target.find(':');
+        if(sep!=target.npos) {
+            if(write)
+                throw std::runtime_error(SB()<<spec<<" : count not allowed with write");
+            if(epicsParseUInt32(target.substr(sep+1).c_str(), &count, 0, 0) || count==0u)
+                throw std::runtime_error(SB()<<spec<<" : invalid count");
+            target = target.substr(0, sep);
+        }
+
+        if(!target.empty() && target[0]>='0' && target[0]<='9') {
+            if(epicsParseUInt32(target.c_str(), &addr, 0, 0))
+                throw std::runtime_error(SB()<<spec<<" : invalid address");
+            if(!write && count==0u)
+                count = 1u;
+        } else if(count) {
+            throw std::runtime_error(SB()<<spec<<" : count only allowed with address");
+        } else {
+            name = target;
+        }
+
+        if(!write) {
+            // nothing more
+        } else if(!value.empty() && value[0]=='@') {
+            std::string raw(read_entire_file(value.c_str()+1));
+            if(raw.empty() || raw.size()%4u)
+                throw std::runtime_error(SB()<<spec<<" : file size must be a non-zero multiple of 4");
+            values.resize(raw.size()/4u);
+            for(size_t i=0; i<values.size(); i++) {
+                epicsUInt32 be;
+                memcpy(&be, &raw[4*i], 4);
+                values[i] = ntohl(be);
+            }
+        } else {
+            size_t start = 0u;
+            while(true) {
+                size_t end = value.find(',', start);
+                epicsUInt32 val;
+                if(epicsParseUInt32(value.substr(start, end==value.npos ? value.npos : end-start).c_str(), &val, 0, 0))
+                    throw std::runtime_error(SB()<<spec<<" : invalid value");
+                values.push_back(val);
+                if(end==value.npos)
+                    break;
+                start = end+1;
+            }
+        }
+
+        if(write && name.empty())
+            count = values.size();
+
+        if(name.empty() && (addr>0x00ffffff || count>0x01000000-addr))
+            throw std::runtime_error(SB()<<spec<<" : outside of 24-bit address space");
+    }
+
+    // find, or create, the register.  Call with device lock held
+    void attach()
+    {
+        if(!name.empty()) {
+            Device::reg_by_name_t::const_iterator it(device->reg_by_name.find(name));
+            if(it==device->reg_by_name.end())
+                throw std::runtime_error(SB()<<spec<<" : no such register");
+            reg = it->second;
+            addr = reg->info.base_addr;
+            count = reg->mem_rx.size();
+
+        } else {
+            epicsUInt32 offset = 0u;
+            if(DevReg *named = device->reg_by_address(addr, &offset))
+                within = SB()<<named->info.name<<"+"<<offset;
+
+            JRegister info;
+            info.name = SB()<<"raw:"<<spec;
+            info.base_addr = addr;
+            info.data_width = 32;
+            info.readable = info.writable = true;
+
+            reg = new DevReg(device, info, false, 0, count);
+            if(!device->reg_raw.insert(std::make_pair(info.name, reg)).second) {
+                delete reg;
+                throw std::runtime_error(SB()<<spec<<" : duplicate");
+            }
+        }
+
+        if(write) {
+            // a partial write would zero the remaining words
+            if(values.size()!=reg->mem_tx.size())
+                throw std::runtime_error(SB()<<spec<<" : "<<values.size()<<" values for "<<reg->mem_tx.size()<<" words");
+            for(size_t i=0; i<values.size(); i++)
+                reg->mem_tx[i] = htonl(values[i]);
+        }
+    }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    try {
+        int opt;
+        bool debug = false, verbose = false, binary = false, skipzero = false;
+        int ninflight = 4;
+        double timeout = 1.0;
+        const char *outname = 0;
+
+        while((opt=getopt(argc, argv, "hdvbZw:t:o:"))!=-1) {
+            switch(opt) {
+            case 'd':
+                debug = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'b':
+                binary = true;
+                break;
+            case 'Z':
+                skipzero = true;
+                break;
+            case 'w':
+                if(epicsParseInt32(optarg, &ninflight, 0, 0) || ninflight<1)
+                    throw std::runtime_error("-w value must be a positive integer");
+                break;
+            case 't':
+                if(epicsParseDouble(optarg, &timeout, 0) || timeout<=0.0)
+                    throw std::runtime_error("-t value must be a positive number");
+                break;
+            case 'o':
+                outname = optarg;
+                break;
+            default:
+                fprintf(stderr, "Unknown option '%c'\n\n", optopt);
+                // fall through
+            case 'h':
+                usage(argv[0]);
+                return 2;
+            }
+        }
+
+        if(optind>=argc) {
+            std::cerr<<"Device address not specified\n\n";
+            usage(argv[0]);
+            return 2;
+        }
+
+        osiSockAddr peer;
+        memset(&peer, 0, sizeof(peer));
+        if(aToIPAddr(argv[optind], feedUDPPortNum, &peer.ia))
+            throw std::runtime_error(SB()<<"Invalid host[:port] "<<argv[optind]);
+
+        // consulted by Device ctor
+        feedNumInFlight = ninflight;
+        feedTimeout = timeout;
+
+        // BlobJob is queued to a callback thread
+        callbackInit();
+
+        osiSockAddr iface;
+        memset(&iface, 0, sizeof(iface));
+        iface.ia.sin_family = AF_INET;
+        iface.ia.sin_addr.s_addr = htonl(INADDR_ANY);
+        iface.ia.sin_port = htons(0);
+
+        // never free'd
+        Device *dev = new Device("dump", iface);
+
+        Waiter waiter;
+        std::vector<Request*> reqs;
+
+        for(int i=optind+1; i<argc; i++) {
+            feed::auto_ptr<Request> req(new Request(dev, waiter));
+            req->parse(argv[i]);
+            reqs.push_back(req.release());
+        }
+
+        const epicsTime start(epicsTime::getCurrent());
+
+        {
+            Guard G(dev->lock);
+            dev->debug = debug ? 0xffffffff : 0u;
+            dev->peer_name = argv[optind];
+            dev->peer_addr = peer;
+            dev->request_reset();
+        }
+        dev->runner.start();
+
+        Guard G(dev->lock);
+
+        // Searching -> Inspecting -> Running.  Allow a few timeouts
+        for(double remaining = 10*timeout; dev->current!=Device::Running && dev->current!=Device::Error && remaining>0.0; remaining-=0.01)
+        {
+            UnGuard U(G);
+            epicsThreadSleep(0.01);
+        }
+        if(dev->current!=Device::Running)
+            throw std::runtime_error(SB()<<"Unable to connect to "<<argv[optind]<<" : "<<Device::current_name[dev->current]
+                                     <<" "<<dev->last_message);
+
+        const epicsTime connected(epicsTime::getCurrent());
+
+        if(reqs.empty()) {
+            for(Device::reg_by_name_t::const_iterator it(dev->reg_by_name.begin()), end(dev->reg_by_name.end());
+                it!=end; ++it)
+            {
+                if(it->second->bootstrap || !it->second->info.readable)
+                    continue;
+                feed::auto_ptr<Request> req(new Request(dev, waiter));
+                // names come from the ROM and need not survive parse()
+                req->spec = req->name = it->first;
+                reqs.push_back(req.release());
+            }
+        }
+
+        for(size_t i=0; i<reqs.size(); i++) {
+            reqs[i]->attach();
+            if(verbose && !reqs[i]->within.empty())
+                std::cerr<<reqs[i]->spec<<" : in "<<reqs[i]->within<<"\n";
+        }
+
+        // queue everything at once to fill the in-flight window
+        {
+            Guard W(waiter.lock);
+            waiter.remaining = reqs.size();
+        }
+        for(size_t i=0; i<reqs.size(); i++)
+            reqs[i]->reg->queue(reqs[i]->write, reqs[i]);
+
+        while(true) {
+            {
+                Guard W(waiter.lock);
+                if(!waiter.remaining)
+                    break;
+            }
+            UnGuard U(G);
+            waiter.evt.wait();
+        }
+
+        const epicsTime done(epicsTime::getCurrent());
+
+        std::ofstream outfile;
+        if(outname) {
+            outfile.open(outname, binary ? std::ios::out|std::ios::binary : std::ios::out);
+            if(!outfile.is_open())
+                throw std::runtime_error(SB()<<"Failed to open "<<outname);
+        }
+        std::ostream& out = outname ? outfile : std::cout;
+
+        int ret = 0;
+        size_t nwords = 0u;
+
+        for(size_t i=0; i<reqs.size(); i++) {
+            const Request& req = *reqs[i];
+            const DevReg& reg = *req.reg;
+
+            if(reg.sevr) {
+                std::cerr<<"Error: "<<req.spec<<" : "<<(req.write ? "write" : "read")<<" failed\n";
+                ret = 1;
+                continue;
+            }
+
+            nwords += reg.mem_rx.size();
+
+            if(req.write)
+                continue;
+
+            if(binary) {
+                // already big endian
+                out.write((const char*)reg.mem_rx.begin(), reg.mem_rx.size()*4u);
+                continue;
+            }
+
+            for(size_t n=0; n<reg.mem_rx.size(); n++) {
+                epicsUInt32 val = ntohl(reg.mem_rx[n]);
+                if(val==0u && skipzero)
+                    continue;
+                char line[20];
+                epicsSnprintf(line, sizeof(line), "%08x %08x\n", unsigned(req.addr+n), unsigned(val));
+                out<<line;
+            }
+        }
+
+        out.flush();
+        if(out.fail())
+            throw std::runtime_error("Error writing output");
+
+        if(verbose) {
+            double xfer = done-connected;
+            std::cerr<<"Connect "<<(connected-start)<<" sec.  Transfer "<<nwords<<" words in "<<xfer<<" sec";
+            if(xfer>0.0)
+                std::cerr<<" ("<<(nwords*4.0/xfer/1e6)<<" MB/s)";
+            std::cerr<<".  "<<dev->cnt_sent<<" packets sent, "<<dev->cnt_timo<<" timeouts\n";
+        }
+
+        {
+            UnGuard U(G);
+            epicsExit(ret); // stops Device worker
+        }
+        return ret;
+    }catch(std::exception& e){
+        std::cerr<<"Error: "<<e.what()<<"\n";
+        epicsExit(1);
+        return 1;
+    }
+}